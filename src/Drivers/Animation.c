@@ -12,6 +12,7 @@
 #include "object.h"
 #include "misc.h"
 #include "sound2.h"
+#include "shape.h"
 #include "externs.h"
 
 /****************************/
@@ -83,6 +84,7 @@ int32_t		offset;
 		{
 			case	ANIMOP_FRAME:
 					theNodePtr->CurrentFrame = operand;
+					theNodePtr->FrameDesc = FindFrameDescriptor(theNodePtr->SpriteGroupNum, theNodePtr->Type, operand);
 					break;
 
 			case	ANIMOP_LOOP:
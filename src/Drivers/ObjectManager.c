@@ -15,12 +15,20 @@
 #include "misc.h"
 #include "shape.h"
 #include <string.h>
+#if _MSC_VER
+#include <intrin.h>
+#endif
 #include "externs.h"
 
 /****************************/
 /*    CONSTANTS             */
 /****************************/
 
+#define	Z_BUCKET_SHIFT		8								// MakeNewObject's insertion index files nodes by Z >> this
+#define	NUM_Z_BUCKETS		(0x10000 >> Z_BUCKET_SHIFT)
+
+#define	MAX_Y_SORT_STEPS	8								// SortObjectsByY walks back this far before using the Z index
+
 /**********************/
 /*     VARIABLES      */
 /**********************/
@@ -28,8 +36,10 @@
 long		gRightSide,gLeftSide,gTopSide,gBottomSide;
 
 											// Region Stuff
-static	Rect		regionList[MAX_REGIONS];
-static	long		numRegions;
+static	long		gUpdateRegionTop = 0;		// rows of gUpdateRegionBits that may have bits set
+static	long		gUpdateRegionBottom = 0;
+long		gUpdateRegionBytes = 0;				// bytes copied by DumpUpdateRegions
+long		gUpdateRectBytes = 0;				// bytes the update rects add up to, overlaps included
 
 											// OBJECT LIST
 long		NumObjects;
@@ -40,6 +50,11 @@ long		NodeStackFront;
 
 ObjNode		*gThisNodePtr,*gMostRecentlyAddedNode;
 
+											// Z INDEX: 1st node (in list order) of each Z bucket
+static	ObjNode		*gZBucketFirst[NUM_Z_BUCKETS];
+static	uint64_t	gZBucketBits[NUM_Z_BUCKETS / 64];	// which buckets are non-empty
+static	Byte		gNodeZBucket[MAX_OBJECTS];			// bucket each node was filed in (its Z may have changed since)
+
 long		gDX,gDY,gSumDX,gSumDY;		// global object stuff
 
 MikeFixed	gX;
@@ -90,6 +105,7 @@ void InitObjectManager(void)
 
 	FirstNodePtr = nil;									// no node yet
 	NumObjects = 0;
+	RebuildObjectZIndex();
 	for (int i = 0; i < MAX_OBJECTS; i++)
 	{
 		// No need to init most fields to 0 since we used NewHandleClear.
@@ -111,16 +127,110 @@ void InitObjectManager(void)
 }
 
 
+/*********************** Z BUCKET ******************/
+
+static inline int ZBucket(unsigned long z)
+{
+	return z > 0xFFFF ? NUM_Z_BUCKETS-1 : (int) (z >> Z_BUCKET_SHIFT);		// callers sometimes wrap Z below 0
+}
+
+
+/*********************** FIND Z BUCKET AT OR BELOW ******************/
+//
+// Returns the highest non-empty bucket <= b, or -1 if there is none.
+//
+
+static int FindZBucketAtOrBelow(int b)
+{
+	for (int w = b >> 6; w >= 0; w--)
+	{
+		uint64_t bits = gZBucketBits[w];
+
+		if (w == (b >> 6))
+			bits &= ~0ull >> (63 - (b & 63));				// ignore buckets above b
+
+		if (bits)
+		{
+			int bit = 63;
+			while (!(bits >> bit))
+				bit--;
+			return (w << 6) + bit;
+		}
+	}
+	return -1;
+}
+
+
+/*********************** FIND LOWEST Z BUCKET ******************/
+//
+// Returns the lowest non-empty bucket, or -1 if the list is empty.
+//
+
+static int FindLowestZBucket(void)
+{
+	for (int w = 0; w < NUM_Z_BUCKETS / 64; w++)
+	{
+		uint64_t bits = gZBucketBits[w];
+
+		if (bits)
+		{
+			int bit = 0;
+			while (!(bits & (1ull << bit)))
+				bit++;
+			return (w << 6) + bit;
+		}
+	}
+	return -1;
+}
+
+
+/*********************** FILE NODE IN Z INDEX ******************/
+//
+// Nodes must be filed in list order, right after the index was cleared.
+//
+
+static inline void FileNodeInZIndex(ObjNode* node)
+{
+	int b = ZBucket(node->Z);
+
+	gNodeZBucket[node->NodeNum] = b;
+	if (gZBucketFirst[b] == nil)
+	{
+		gZBucketFirst[b] = node;
+		gZBucketBits[b >> 6] |= 1ull << (b & 63);
+	}
+}
+
+
+/*********************** REBUILD OBJECT Z INDEX ******************/
+//
+// Refiles every node by its current Z.  Call whenever the list was reordered
+// or its Z's were changed behind MakeNewObject's back (sorting, loading a player).
+//
+
+void RebuildObjectZIndex(void)
+{
+	memset(gZBucketFirst, 0, sizeof(gZBucketFirst));
+	memset(gZBucketBits, 0, sizeof(gZBucketBits));
+
+	for (ObjNode* node = FirstNodePtr; node != nil; node = node->NextNode)
+		FileNodeInZIndex(node);
+}
+
+
 /*********************** MAKE NEW OBJECT ******************/
 //
 // MAKE NEW OBJECT & RETURN PTR TO IT
 //
 // The linked list is sorted from LARGEST z to smallest!
+// Rather than scanning from the head, the search for the insertion place starts at the
+// 1st node of the closest non-empty Z bucket at or below z, so it only visits nodes of similar Z.
 //
 
 ObjNode	*MakeNewObject(Byte genre, short x, short y, unsigned short z, void (*moveCall)(void))
 {
 register ObjNode	*newNodePtr,*scanNodePtr,*reNodePtr;
+int					bucket,startBucket;
 
 
 	if (NumObjects == (MAX_OBJECTS-1))			// check for overflow
@@ -154,31 +264,33 @@ register ObjNode	*newNodePtr,*scanNodePtr,*reNodePtr;
 
 					/* FIND INSERTION PLACE FOR NODE */
 
-	if (FirstNodePtr == nil)							// special case only entry
+	bucket = ZBucket(z);
+	startBucket = FindZBucketAtOrBelow(bucket);
+
+	if (startBucket < 0)								// nothing at or below z: scan the lowest bucket to the end
+		startBucket = FindLowestZBucket();
+
+	if (startBucket < 0)								// special case only entry
 	{
 		FirstNodePtr = newNodePtr;
 		newNodePtr->PrevNode = nil;
 		newNodePtr->NextNode = nil;
 	}
-	else if (z >= FirstNodePtr->Z)						// INSERT AS FIRST NODE
-	{
-		newNodePtr->PrevNode = nil;						// no prev
-		newNodePtr->NextNode = FirstNodePtr; 		// next pts to old 1st
-		FirstNodePtr->PrevNode = newNodePtr; 		// old pts to new 1st
-		FirstNodePtr = newNodePtr;
-	}
 	else
 	{
-		reNodePtr = FirstNodePtr;
-		scanNodePtr = FirstNodePtr;
+		scanNodePtr = gZBucketFirst[startBucket];
+		reNodePtr = scanNodePtr->PrevNode;
 
 		while (scanNodePtr != nil)
 		{
-			if (z >= scanNodePtr->Z)						// INSERT IN MIDDLE HERE
+			if (z >= scanNodePtr->Z)						// INSERT HERE
 			{
 				newNodePtr->NextNode = scanNodePtr;
 				newNodePtr->PrevNode = reNodePtr;
-				reNodePtr->NextNode = newNodePtr;
+				if (reNodePtr)
+					reNodePtr->NextNode = newNodePtr;
+				else
+					FirstNodePtr = newNodePtr;				// new 1st node
 				scanNodePtr->PrevNode = newNodePtr;
 				goto out;
 			}
@@ -192,6 +304,20 @@ register ObjNode	*newNodePtr,*scanNodePtr,*reNodePtr;
 	}
 
 out:
+					/* FILE IT IN ITS Z BUCKET */
+
+	gNodeZBucket[newNodePtr->NodeNum] = bucket;
+
+	if (gZBucketFirst[bucket] == nil)						// 1st of its bucket
+	{
+		gZBucketFirst[bucket] = newNodePtr;
+		gZBucketBits[bucket >> 6] |= 1ull << (bucket & 63);
+	}
+	else if (gZBucketFirst[bucket] == newNodePtr->NextNode)	// went in ahead of its bucket's old 1st
+	{
+		gZBucketFirst[bucket] = newNodePtr;
+	}
+
 	NumObjects++;											// its done
 	gMostRecentlyAddedNode = newNodePtr;					// remember this
 	return(newNodePtr);
@@ -263,6 +389,10 @@ void EraseObjects(void)
 {
 register	ObjNode		*thisNodePtr;
 
+	FlushPendingPlayfieldCopy();			// the screen must get the PF sprites before they're erased
+
+	RestoreDirtyPFTiles();					// PF sprites get erased a whole tile at a time
+
 	if (FirstNodePtr == nil)				// see if there are any objects
 		return;
 
@@ -303,10 +433,49 @@ register	ObjNode		*thisNodePtr;
 
 
 /************************ INIT REGION LIST *****************/
+//
+// Update regions accumulate in gUpdateRegionBits, one bit per offscreen pixel,
+// so overlapping rects are only copied once and the list can never overflow.
+//
 
 void InitRegionList(void)
 {
-		numRegions = 0;
+	if (gUpdateRegionBottom > OFFSCREEN_HEIGHT)		// buffers may have shrunk since
+		gUpdateRegionBottom = OFFSCREEN_HEIGHT;
+
+	if (gUpdateRegionBits && gUpdateRegionBottom > gUpdateRegionTop)
+	{
+		memset(gUpdateRegionBits + gUpdateRegionTop * gUpdateRegionWords, 0,
+				(gUpdateRegionBottom - gUpdateRegionTop) * gUpdateRegionWords * sizeof(uint64_t));
+	}
+
+	gUpdateRegionTop = OFFSCREEN_HEIGHT;
+	gUpdateRegionBottom = 0;
+}
+
+
+/*********************** SET UPDATE BITS ****************/
+//
+// Sets bits [left, right) of one row of gUpdateRegionBits.
+//
+
+static void SetUpdateBits(uint64_t* bits, long left, long right)
+{
+	long		w		= left >> 6;
+	long		w2		= (right - 1) >> 6;
+	uint64_t	first	= ~0ull << (left & 63);
+	uint64_t	last	= ~0ull >> (63 - ((right - 1) & 63));
+
+	if (w == w2)
+	{
+		bits[w] |= first & last;
+		return;
+	}
+
+	bits[w] |= first;
+	for (w++; w < w2; w++)
+		bits[w] = ~0ull;
+	bits[w2] |= last;
 }
 
 
@@ -342,12 +511,44 @@ void AddUpdateRegion(Rect theRegion,Byte clipNum)
 	if (theRegion.right < theRegion.left)				// check for cross overlapping
 		theRegion.right = theRegion.left;
 
-					/* ADD TO LIST */
+	if (!gUpdateRegionBits)								// no offscreen buffer yet
+		return;
+
+					/* CALC PIXELS TO COPY */
+
+	long top	= theRegion.top;
+	long bottom	= theRegion.bottom;
+	long left	= theRegion.left;
+	long right	= left + ((((theRegion.right - left) >> 2) + 1) << 2);	// right edge is inclusive, in longs
+
+	if (bottom == top)									// special check for 0 heights
+		bottom++;
+
+	GAME_ASSERT(top >= OFFSCREEN_WINDOW_TOP);
+	GAME_ASSERT(left >= OFFSCREEN_WINDOW_LEFT);
+
+	if (bottom > OFFSCREEN_WINDOW_BOTTOM)				// don't spill off the screen
+		bottom = OFFSCREEN_WINDOW_BOTTOM;
 
-	if (numRegions < MAX_REGIONS)				// make sure dont overflow list
+	if (right > OFFSCREEN_WINDOW_LEFT + VISIBLE_WIDTH)
+		right = OFFSCREEN_WINDOW_LEFT + VISIBLE_WIDTH;
+
+	if (top >= bottom || left >= right)
+		return;
+
+					/* ADD TO BITMAP */
+
+	for (long y = top; y < bottom; y++)
 	{
-		regionList[numRegions++] = theRegion;
+		SetUpdateBits(gUpdateRegionBits + y * gUpdateRegionWords, left, right);
 	}
+
+	if (gUpdateRegionTop > top)
+		gUpdateRegionTop = top;
+	if (gUpdateRegionBottom < bottom)
+		gUpdateRegionBottom = bottom;
+
+	gUpdateRectBytes += (bottom - top) * (right - left);
 }
 
 
@@ -436,6 +637,23 @@ Rect	box;
 		return;
 	}
 
+					/* REMOVE FROM Z INDEX */
+
+	int bucket = gNodeZBucket[theNode->NodeNum];
+	if (gZBucketFirst[bucket] == theNode)
+	{
+		tempNode = theNode->NextNode;
+		if (tempNode && gNodeZBucket[tempNode->NodeNum] == bucket)	// next in line takes over the bucket
+		{
+			gZBucketFirst[bucket] = tempNode;
+		}
+		else
+		{
+			gZBucketFirst[bucket] = nil;
+			gZBucketBits[bucket >> 6] &= ~(1ull << (bucket & 63));
+		}
+	}
+
 					/* DO NODE SWITCHING */
 
 	if (theNode->PrevNode == nil)					// special case 1st node
@@ -563,66 +781,110 @@ static	Rect	box;
 
 /****************** SORT OBJECTS BY Y *********************/
 //
-// Does a pseudo bubble sort based on an object's Y coord.
+// Insertion sorts the objects between the "farthest" and "nearest" Z ranges by Y coord.
 // Remember that list is in LARGEST to SMALLEST order, so Y coord is
 // inversely related to Z coord.
 //
+// The order barely changes from one frame to the next, so this is a single walk down
+// the list plus a short walk back for each object that moved up (objects that moved
+// further jump back through the Z index of the part that's already sorted).
+// Equal Y's keep their current order.  The Z index is refiled along the way.
+//
 
 void SortObjectsByY(void)
 {
-register	ObjNode 	*nodePtr,*nextNode;
+ObjNode		*nodePtr,*nextNode,*sortedTail,*scanNode;
+ObjNode		*segmentPrev;
+int			b,lowerBucket,steps;
 
 	if (NumObjects < 2)									// see if anything to sort
 		return;
 
+	memset(gZBucketFirst, 0, sizeof(gZBucketFirst));	// Z's are about to change, so refile everything
+	memset(gZBucketBits, 0, sizeof(gZBucketBits));
+
 	nodePtr = FirstNodePtr;								// start with 1st node
 
 				/* SKIP Z'S WHICH ARE IN "FARTHEST" RANGE */
 
 	while (nodePtr->Z >= FARTHEST_Z)
 	{
+		FileNodeInZIndex(nodePtr);
 		nodePtr = nodePtr->NextNode;
 		if (nodePtr == nil)								// if end, then exit
 			return;
 	}
 
+	segmentPrev = nodePtr->PrevNode;
+	sortedTail = nil;
 
 						/* SORT */
 
-	while ((nextNode = nodePtr->NextNode) != nil)		// scan until end
+	for ( ; nodePtr != nil && nodePtr->Z > NEAREST_Z; nodePtr = nextNode)
 	{
-		if (nextNode->Z <= NEAREST_Z)					// stop if gets to "Nearest" range
-			return;
-
+		nextNode = nodePtr->NextNode;
 		nodePtr->Z = (0x7FFF - nodePtr->Y.Int);			// Z = (MAXY - Y coord)
+		b = ZBucket(nodePtr->Z);
+		gNodeZBucket[nodePtr->NodeNum] = b;
 
-		if (nodePtr->Y.Int > nextNode->Y.Int)			// if this Y is below next, then must swap
+		if (sortedTail == nil || sortedTail->Y.Int <= nodePtr->Y.Int)	// already in place
 		{
-			nextNode->Z = (0x7FFF - nextNode->Y.Int);	// set this Z since about to get swapped
-			if (nodePtr == FirstNodePtr)				// see if was 1st node
+			sortedTail = nodePtr;
+			if (gZBucketFirst[b] == nil)
 			{
-				FirstNodePtr = nextNode;				// next is now the 1st node
-				nextNode->PrevNode = nil;
-				nodePtr->NextNode = nextNode->NextNode;
-				if (nextNode->NextNode)
-					nextNode->NextNode->PrevNode = nodePtr;	// next's next's prev now pts to current
-				nodePtr->PrevNode = nextNode;
-				nextNode->NextNode = nodePtr;
+				gZBucketFirst[b] = nodePtr;
+				gZBucketBits[b >> 6] |= 1ull << (b & 63);
 			}
+			continue;
+		}
+
+					/* FIND 1ST SORTED NODE WITH A BIGGER Y */
+
+		sortedTail->NextNode = nextNode;				// unlink
+		if (nextNode)
+			nextNode->PrevNode = sortedTail;
+
+		scanNode = sortedTail;
+		for (steps = 0; steps < MAX_Y_SORT_STEPS; steps++)			// most objects only drift past a neighbor or two
+		{
+			if (scanNode->PrevNode == segmentPrev || scanNode->PrevNode->Y.Int <= nodePtr->Y.Int)
+				break;
+			scanNode = scanNode->PrevNode;
+		}
+
+		if (steps == MAX_Y_SORT_STEPS)								// moved far: jump there with the Z index
+		{
+			if (b != ZBucket(FARTHEST_Z) && gZBucketFirst[b])	// skip to its bucket in the sorted part...
+				scanNode = gZBucketFirst[b];
+			else if (b > 0 && (lowerBucket = FindZBucketAtOrBelow(b-1)) >= 0)	// ...or to the bucket after it
+				scanNode = gZBucketFirst[lowerBucket];
 			else
-			{
-				nextNode->PrevNode = nodePtr->PrevNode;
-				nodePtr->PrevNode->NextNode	= nextNode;	// current's prev's next pts to next
-				nodePtr->NextNode = nextNode->NextNode;
-				if (nextNode->NextNode)
-					nextNode->NextNode->PrevNode = nodePtr;	// next's next's prev now pts to current
-
-				nodePtr->PrevNode = nextNode;
-				nextNode->NextNode = nodePtr;
-			}
+				scanNode = segmentPrev ? segmentPrev->NextNode : FirstNodePtr;
+
+			while (scanNode->Y.Int <= nodePtr->Y.Int)	// equal Y's stay in front
+				scanNode = scanNode->NextNode;
+		}
+
+					/* MOVE IT UP IN FRONT OF THAT NODE */
+
+		nodePtr->PrevNode = scanNode->PrevNode;
+		nodePtr->NextNode = scanNode;
+		if (scanNode->PrevNode)
+			scanNode->PrevNode->NextNode = nodePtr;
+		else
+			FirstNodePtr = nodePtr;
+		scanNode->PrevNode = nodePtr;
+
+		if (gZBucketFirst[b] == nil || gZBucketFirst[b] == scanNode)	// went in ahead of its bucket's old 1st
+		{
+			if (gZBucketFirst[b] == nil)
+				gZBucketBits[b >> 6] |= 1ull << (b & 63);
+			gZBucketFirst[b] = nodePtr;
 		}
-		nodePtr = nextNode;								// point to next node
 	}
+
+	for ( ; nodePtr != nil; nodePtr = nodePtr->NextNode)	// "nearest" range is left as is
+		FileNodeInZIndex(nodePtr);
 }
 
 
@@ -638,50 +900,88 @@ void SimpleObjectMove(void)
 }
 
 
+/********************* COUNT TRAILING ZEROS ***************/
+
+static inline int CountTrailingZeros64(uint64_t v)		// v must not be 0
+{
+#if _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, v);
+	return (int) index;
+#else
+	return __builtin_ctzll(v);
+#endif
+}
+
+
 /********************* DUMP UPDATE REGIONS (DON'T PRESENT FRAMEBUFFER) ***************/
+//
+// Copies every marked pixel from the offscreen buffer to the screen.
+// Each row's marked pixels are copied as runs, so overlapping rects
+// cost nothing extra & a fully covered row is a single memcpy.
+// Run boundaries are found a word at a time by counting trailing zeros
+// of the bitmap word (start of run) or of its complement (end of run).
+//
 
 void DumpUpdateRegions_DontPresentFramebuffer(void)
 {
-	if (numRegions == 0)
+	if (gUpdateRegionBottom <= gUpdateRegionTop)
 		return;
 
+					/* UPDATE ALL OF THE MARKED ROWS */
 
-					/* UPDATE ALL OF THE REGIONS */
-
-	for (int regionNum = 0; regionNum < numRegions; regionNum++)
+	for (long y = gUpdateRegionTop; y < gUpdateRegionBottom; y++)
 	{
-		int top		= regionList[regionNum].top;
-		int bottom	= regionList[regionNum].bottom;
-		int height	= bottom-top;
-
-		int left	= 	regionList[regionNum].left;
-		int right	=	regionList[regionNum].right;
+		uint64_t*	bits	= gUpdateRegionBits + y * gUpdateRegionWords;
+		int			screenY	= y - OFFSCREEN_WINDOW_TOP;
+		Boolean		copied	= false;
 
-		int width = ((right-left)>>2)+1;				// in longs
-		width <<= 2;									// convert back to bytes
-
-		GAME_ASSERT(top-OFFSCREEN_WINDOW_TOP >= 0);
-		GAME_ASSERT(left-OFFSCREEN_WINDOW_LEFT >= 0);
+		if (!IsInterlacedRow(screenY))					// leave blank interlace lines alone
+		{
+			long x = 0;
 
-		const uint8_t* srcPtr	= gOffScreenLookUpTable[top]+left;
-		uint8_t* destPtr		= gScreenLookUpTable[top-OFFSCREEN_WINDOW_TOP] + left-OFFSCREEN_WINDOW_LEFT;
+			while (x < OFFSCREEN_WIDTH)
+			{
+				uint64_t marked = bits[x >> 6] >> (x & 63);				// skip clean pixels
+				if (!marked)
+				{
+					x = (x | 63) + 1;									// rest of this word is clean
+					continue;
+				}
+
+				x += CountTrailingZeros64(marked);
+				if (x >= OFFSCREEN_WIDTH)
+					break;
+
+				long left = x;
+
+				while (x < OFFSCREEN_WIDTH)								// find end of run
+				{
+					uint64_t clean = ~bits[x >> 6] >> (x & 63);
+					if (clean)
+					{
+						x += CountTrailingZeros64(clean);
+						break;
+					}
+					x = (x | 63) + 1;									// rest of this word is marked
+				}
+
+				if (x > OFFSCREEN_WIDTH)
+					x = OFFSCREEN_WIDTH;
 
 						/* DO THE QUICK COPY */
 
-		if (!height)									// special check for 0 heights
-			height = 1;
-
-		do
-		{
-			memcpy(destPtr, srcPtr, width);
-
-			destPtr += VISIBLE_WIDTH;					// Bump to start of next row.
-			srcPtr += OFFSCREEN_WIDTH;
+				memcpy(gScreenLookUpTable[screenY] + left-OFFSCREEN_WINDOW_LEFT, gOffScreenLookUpTable[y] + left, x - left);
+				gUpdateRegionBytes += x - left;
+				copied = true;
+			}
+		}
 
-		} while (--height);
+		if (copied)
+			MarkFramebufferRowsDirty(screenY, 1);
 	}
 
-	numRegions = 0;								// reset # regions to 0
+	InitRegionList();							// clear the bitmap
 }
 
 /********************* DUMP UPDATE REGIONS (AND PRESENT FRAMEBUFFER) ***************/
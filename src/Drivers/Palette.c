@@ -159,6 +159,7 @@ void FadeOutGameCLUT(void)
 
 			/* LOCK PresentIndexedFramebuffer UNTIL NEXT FADEIN */
 
+	FlushPresentPipeline();									// make sure the darkest frame gets shown
 	gScreenBlankedFlag = true;
 
 	RestoreBackUpPalette();
@@ -14,6 +14,7 @@
 #include "object.h"
 #include "misc.h"
 #include "shape.h"
+#include "spriteblit.h"
 #include <string.h>
 #include "externs.h"
 
@@ -22,12 +23,52 @@
 /****************************/
 
 static void DrawPFSprite(ObjNode *theNodePtr);
-static void ErasePFSprite(ObjNode *theNodePtr);
+static void MarkDirtyPFTiles(long x, long y, long width, long height);
+static void BuildFrameTable(long groupNum);
+static void DisposeFrameTable(long groupNum);
 
 /****************************/
 /*    CONSTANTS             */
 /****************************/
 
+#define	MIN_COPY_SPAN		4				// opaque runs shorter than this are folded into masked runs
+
+enum
+{
+	kSpanPixel_Skip,						// mask keeps the background & no pixel to OR in
+	kSpanPixel_Opaque,						// mask clears the background: straight copy
+	kSpanPixel_Masked						// anything else needs (dest & mask) | src
+};
+
+#define	FRAME_TABLE_ALIGN	64				// frame descriptors are cache-line aligned
+
+#define	INTERLEAVE_ALIGN	16				// interleaved pixel & mask rows start on vector boundaries
+
+typedef struct ShapeFrameTable
+{
+	Ptr					block;							// single allocation holding the descriptors & span lists
+	Ptr					pixelBlock;						// interleaved pixel & mask rows (nil unless gInterleaveShapes)
+	FrameDescriptor*	frames;							// every frame of every shape back to back
+	int32_t				firstFrame[MAX_SHAPES_IN_FILE];	// index of each shape's frame 0 in frames
+	int16_t				numFrames[MAX_SHAPES_IN_FILE];
+	long				dataBytes;						// size of the group's shape file, as loaded
+	long				tableBytes;						// dataBytes + descriptors, span lists & interleaved rows
+} ShapeFrameTable;
+
+// One clipped, non-wrapping rectangle of a sprite, ready to blit
+typedef struct SpriteDraw
+{
+	const FrameDescriptor*	fd;
+	uint8_t* const*			destRows;		// row lookup table of the target buffer
+	uint8_t* const*			tileMaskRows;	// nil unless drawn behind priority tiles
+	int16_t					destX;
+	int16_t					destY;			// first target row
+	int16_t					numRows;
+	int16_t					frameRow;		// frame row that lands on destY
+	int16_t					colStart;		// frame columns to draw
+	int16_t					colEnd;
+} SpriteDraw;
+
 /**********************/
 /*     VARIABLES      */
 /**********************/
@@ -38,8 +79,16 @@ Ptr		gSHAPE_HEADER_Ptrs[MAX_SHAPE_GROUPS][MAX_SHAPES_IN_FILE];			// holds ptr to
 
 static	short		gNumShapesInFile[MAX_SHAPE_GROUPS];
 
+static	ShapeFrameTable	gShapeFrames[MAX_SHAPE_GROUPS];		// flattened frame descriptors for each group
+
 ObjNode	*gMostRecentShape = nil;
 
+long	gPFTileEraseBytes = 0;
+long	gPFRectEraseBytes = 0;
+
+long	gShapeDataBytes = 0;
+long	gShapeTableBytes = 0;
+
 
 /************************ MAKE NEW SHAPE ***********************/
 //
@@ -92,6 +141,7 @@ int32_t	offset;
 	newSpritePtr->AnimLine =
 	newSpritePtr->CurrentFrame =							// set to 0 just to be safe!!!
 	newSpritePtr->AnimCount = 0;
+	newSpritePtr->FrameDesc = FindFrameDescriptor(groupNum, type, 0);
 
 	newSpritePtr->DZ = 0;
 
@@ -125,6 +175,7 @@ void LoadShapeTable(const char* fileName, long groupNum)
 	{
 		DisposeHandle(gShapeTableHandle[groupNum]);
 		memset(gSHAPE_HEADER_Ptrs[groupNum], 0, sizeof(gSHAPE_HEADER_Ptrs[groupNum]));
+		DisposeFrameTable(groupNum);
 	}
 
 	gShapeTableHandle[groupNum] = LoadPackedFile(fileName);
@@ -223,6 +274,8 @@ void LoadShapeTable(const char* fileName, long groupNum)
 
 //		printf("Num Anims: %d    Num Frames: %d\n", numAnims, numFrames);
 	}
+
+	BuildFrameTable(groupNum);
 }
 
 /************************ GET FRAME HEADER ********************/
@@ -275,6 +328,459 @@ const FrameHeader* GetFrameHeader(
 	return fh;
 }
 
+/************************ CLASSIFY SPAN PIXEL ********************/
+
+static inline int ClassifySpanPixel(uint8_t pixel, uint8_t mask)
+{
+	if (mask == 0xff && pixel == 0)				// (dest & 0xff) | 0 == dest
+		return kSpanPixel_Skip;
+
+	if (mask == 0x00)							// (dest & 0) | pixel == pixel
+		return kSpanPixel_Opaque;
+
+	return kSpanPixel_Masked;
+}
+
+/************************ COMPILE SPAN ROW ********************/
+//
+// Splits one row of a frame into opaque & masked runs. Skip runs aren't stored.
+// mask == nil means the frame has no mask and is fully opaque.
+// Returns the # of spans; only writes them out if outSpans isn't nil.
+//
+
+static int CompileSpanRow(const uint8_t* pixels, const uint8_t* mask, int width, SpriteSpan* outSpans)
+{
+int			numSpans = 0;
+SpriteSpan	span = {0};
+Boolean		spanOpen = false;
+
+	for (int x = 0; x < width; )
+	{
+					/* FIND END OF RUN */
+
+		int kind = ClassifySpanPixel(pixels[x], mask? mask[x]: 0x00);
+		int end = x + 1;
+
+		while (end < width && ClassifySpanPixel(pixels[end], mask? mask[end]: 0x00) == kind)
+			end++;
+
+		if (mask && kind == kSpanPixel_Opaque && end-x < MIN_COPY_SPAN)	// not worth a memcpy (needs a mask to fall back on)
+			kind = kSpanPixel_Masked;
+
+					/* CLOSE SPAN IF THE KIND CHANGES */
+
+		if (spanOpen && (kind == kSpanPixel_Skip || (kind == kSpanPixel_Opaque) != span.opaque))
+		{
+			if (outSpans)
+				outSpans[numSpans] = span;
+			numSpans++;
+			spanOpen = false;
+		}
+
+					/* OPEN OR GROW SPAN */
+
+		if (kind != kSpanPixel_Skip)
+		{
+			if (!spanOpen)
+			{
+				span.x = x;
+				span.width = 0;
+				span.opaque = (kind == kSpanPixel_Opaque);
+				spanOpen = true;
+			}
+			span.width += end - x;
+		}
+
+		x = end;
+	}
+
+	if (spanOpen)
+	{
+		if (outSpans)
+			outSpans[numSpans] = span;
+		numSpans++;
+	}
+
+	return numSpans;
+}
+
+/************************ GET NUM FRAMES IN SHAPE ********************/
+
+static int GetNumFramesInShape(long groupNum, long shapeNum)
+{
+	const uint8_t* shapePtr = (const uint8_t*) gSHAPE_HEADER_Ptrs[groupNum][shapeNum];
+	GAME_ASSERT(shapePtr);
+
+	int32_t offsetToFrameList = *(int32_t*) (shapePtr+2);
+	return ((const FrameList*) (shapePtr + offsetToFrameList))->numFrames;
+}
+
+/************************ DISPOSE FRAME TABLE ********************/
+
+static void DisposeFrameTable(long groupNum)
+{
+	gShapeDataBytes -= gShapeFrames[groupNum].dataBytes;
+	gShapeTableBytes -= gShapeFrames[groupNum].tableBytes;
+
+	CHECKED_DISPOSEPTR(gShapeFrames[groupNum].block);
+	CHECKED_DISPOSEPTR(gShapeFrames[groupNum].pixelBlock);
+	memset(&gShapeFrames[groupNum], 0, sizeof(gShapeFrames[groupNum]));
+}
+
+/************************ FIND FRAME DESCRIPTOR ********************/
+//
+// Returns nil if the frame doesn't exist. Some anims in the data reference frames
+// that are never drawn, so it's up to the draw code to complain about nil.
+//
+
+const FrameDescriptor* FindFrameDescriptor(long groupNum, long shapeNum, long frameNum)
+{
+	if (groupNum < 0 || groupNum >= MAX_SHAPE_GROUPS)
+		return nil;
+
+	const ShapeFrameTable* table = &gShapeFrames[groupNum];
+
+	if (!table->frames ||
+		shapeNum < 0 || shapeNum >= gNumShapesInFile[groupNum] ||
+		frameNum < 0 || frameNum >= table->numFrames[shapeNum])
+		return nil;
+
+	return &table->frames[table->firstFrame[shapeNum] + frameNum];
+}
+
+/************************ GET FRAME DESCRIPTOR ********************/
+
+const FrameDescriptor* GetFrameDescriptor(long groupNum, long shapeNum, long frameNum)
+{
+	GAME_ASSERT_MESSAGE(groupNum < MAX_SHAPE_GROUPS, "Illegal Group #");
+	GAME_ASSERT_MESSAGE(shapeNum < gNumShapesInFile[groupNum], "Illegal Shape #");
+
+	const FrameDescriptor* fd = FindFrameDescriptor(groupNum, shapeNum, frameNum);
+	GAME_ASSERT_MESSAGE(fd, "Illegal Frame #");
+
+	return fd;
+}
+
+/************************ DRAW SPAN ROW ********************/
+//
+// Draws columns [colStart, colEnd) of one frame row. dest (and tileMask, if any)
+// point to where column colStart goes.
+// With a tile mask, background pixels under the tile mask stay in front of the sprite.
+//
+
+static void DrawSpanRow(
+		uint8_t* dest,
+		const uint8_t* tileMask,
+		const FrameDescriptor* fd,
+		int row,
+		int colStart,
+		int colEnd)
+{
+	const int32_t*		rowSpans	= GetFrameRowSpans(fd);
+	const uint8_t*		pixels		= fd->pixels + row * fd->rowBytes;
+	const uint8_t*		mask		= fd->mask? fd->mask + row * fd->rowBytes: nil;	// only read by masked spans
+	const SpriteSpan*	spans		= GetFrameSpans(fd);
+	const SpriteSpan*	span		= spans + rowSpans[row];
+	const SpriteSpan*	lastSpan	= spans + rowSpans[row+1];
+
+	for (; span < lastSpan; span++)
+	{
+		int start	= span->x;
+		int end		= start + span->width;
+
+		if (end <= colStart)						// left of the clip range
+			continue;
+
+		if (start >= colEnd)						// spans are sorted, so the rest is clipped too
+			break;
+
+		if (start < colStart)
+			start = colStart;
+
+		if (end > colEnd)
+			end = colEnd;
+
+		uint8_t* d = dest + (start - colStart);
+
+		if (tileMask)
+			gBlitTileMaskedSpan(d, tileMask + (start - colStart), pixels + start, span->opaque? nil: mask + start, end - start);
+		else if (span->opaque)
+			memcpy(d, pixels + start, end - start);
+		else
+			gBlitMaskedSpan(d, pixels + start, mask + start, end - start);
+	}
+}
+
+#if _DEBUG
+/************************ VERIFY FRAME TABLE ********************/
+//
+// Checks that every descriptor agrees with the raw frame header, then blits every row
+// of every frame with random backgrounds, tile masks & clip ranges, and makes sure
+// the span blitter matches the old per-pixel mask math (an unmasked frame acts as if
+// its mask were all 0x00).
+//
+
+static void VerifyFrameTable(long groupNum)
+{
+enum { kMaxVerifyWidth = 1024 };
+uint8_t		background[kMaxVerifyWidth];
+uint8_t		tileMask[kMaxVerifyWidth];
+uint8_t		expected[kMaxVerifyWidth];
+uint8_t		actual[kMaxVerifyWidth];
+uint32_t	seed = 0x2545F491;
+
+	for (int s = 0; s < gNumShapesInFile[groupNum]; s++)
+	{
+		int numFrames = GetNumFramesInShape(groupNum, s);
+
+		for (int f = 0; f < numFrames; f++)
+		{
+			const uint8_t* pixels;
+			const uint8_t* mask;
+			const FrameHeader* fh = GetFrameHeader(groupNum, s, f, &pixels, &mask);
+			const FrameDescriptor* fd = GetFrameDescriptor(groupNum, s, f);
+			const int width = fh->width;
+
+			if (fh->maskOffset == 0)						// frame has no mask
+				mask = nil;
+
+			GAME_ASSERT(fd->width == fh->width && fd->height == fh->height);
+			GAME_ASSERT(fd->x == fh->x && fd->y == fh->y);
+			GAME_ASSERT((fd->mask == nil) == (fh->maskOffset == 0));
+			GAME_ASSERT(fd->rowBytes >= width);
+
+			for (int row = 0; row < fh->height; row++)		// rows may have been moved by the interleaver
+			{
+				GAME_ASSERT(0 == memcmp(fd->pixels + row*fd->rowBytes, pixels + row*width, width));
+				GAME_ASSERT(!fd->mask || 0 == memcmp(fd->mask + row*fd->rowBytes, mask + row*width, width));
+			}
+
+			GAME_ASSERT(width <= kMaxVerifyWidth);
+
+			for (int row = 0; row < fh->height; row++)
+			{
+				for (int pass = 0; pass < 3; pass++)
+				{
+					for (int i = 0; i < width; i++)
+					{
+						seed = seed * 1664525u + 1013904223u;
+						background[i] = seed >> 24;
+						tileMask[i] = (seed >> 8) & 0xff;
+					}
+
+					int colStart = 0;
+					int colEnd = width;
+					if (pass == 2 && width > 0)							// random clip range
+					{
+						seed = seed * 1664525u + 1013904223u;
+						colStart = (seed >> 16) % width;
+						colEnd = colStart + 1 + (seed >> 8) % (width - colStart);
+					}
+
+					const uint8_t* tm = (pass == 1)? tileMask + colStart: nil;
+
+					for (int i = colStart; i < colEnd; i++)
+					{
+						uint8_t m = mask? mask[i]: 0x00;
+						if (tm)
+							expected[i] = (background[i] & (m | tileMask[i])) | (pixels[i] & ~tileMask[i]);
+						else
+							expected[i] = (background[i] & m) | pixels[i];
+					}
+
+					memcpy(actual, background, width);
+					DrawSpanRow(actual + colStart, tm, fd, row, colStart, colEnd);
+
+					GAME_ASSERT_MESSAGE(0 == memcmp(actual + colStart, expected + colStart, colEnd - colStart),
+										"Span blit doesn't match mask blit");
+				}
+
+				pixels += width;
+				if (mask)
+					mask += width;
+			}
+		}
+	}
+}
+#endif
+
+/************************ BUILD FRAME TABLE ********************/
+//
+// Flattens every frame of a freshly loaded shape table into a cache-aligned array of
+// FrameDescriptors, validating all offsets once so the draw code can trust them.
+// Each frame also gets precompiled into per-row span lists so the blitters can
+// memcpy opaque runs and only apply the mask around the edges.
+// Pass 0 counts & validates, pass 1 fills in the table.
+//
+// With gInterleaveShapes, every frame's pixels are also copied into a separate block
+// where each row of pixels is immediately followed by the same row of its mask, both
+// padded to INTERLEAVE_ALIGN. A masked row then only touches one run of cache lines
+// instead of two that are a whole frame apart. The original data stays in the handle
+// because GetFrameHeader users (fonts, etc.) still read it directly.
+//
+
+static void BuildFrameTable(long groupNum)
+{
+ShapeFrameTable*	table = &gShapeFrames[groupNum];
+Handle				shapeTableHandle = gShapeTableHandle[groupNum];
+int32_t				numFrames = 0;
+long				spanBytes = 0;
+long				interleavedBytes = 0;
+uint8_t*			spanData = nil;
+uint8_t*			interleavedData = nil;
+
+	DisposeFrameTable(groupNum);
+
+	if (!gBlitMaskedSpan)
+		InitSpriteBlitKernels();
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		if (pass == 1)
+		{
+					/* ALLOCATE THE TABLE */
+
+			table->block = NewPtr(FRAME_TABLE_ALIGN-1 + numFrames*sizeof(FrameDescriptor) + spanBytes);
+			GAME_ASSERT_MESSAGE(table->block, "No memory for frame table!");
+
+			uintptr_t aligned = ((uintptr_t) table->block + FRAME_TABLE_ALIGN-1) & ~(uintptr_t)(FRAME_TABLE_ALIGN-1);
+			table->frames = (FrameDescriptor*) aligned;
+			spanData = (uint8_t*) (table->frames + numFrames);
+
+			if (gInterleaveShapes)
+			{
+				table->pixelBlock = NewPtr(INTERLEAVE_ALIGN-1 + interleavedBytes);
+				GAME_ASSERT_MESSAGE(table->pixelBlock, "No memory for interleaved shapes!");
+
+				aligned = ((uintptr_t) table->pixelBlock + INTERLEAVE_ALIGN-1) & ~(uintptr_t)(INTERLEAVE_ALIGN-1);
+				interleavedData = (uint8_t*) aligned;
+			}
+
+			numFrames = 0;
+			spanBytes = 0;
+			interleavedBytes = 0;
+		}
+
+		for (int s = 0; s < gNumShapesInFile[groupNum]; s++)
+		{
+			int numFramesInShape = GetNumFramesInShape(groupNum, s);
+
+			if (pass == 1)
+			{
+				table->firstFrame[s] = numFrames;
+				table->numFrames[s] = numFramesInShape;
+			}
+
+			for (int f = 0; f < numFramesInShape; f++)
+			{
+				const uint8_t* pixels;
+				const uint8_t* mask;
+				const FrameHeader* fh = GetFrameHeader(groupNum, s, f, &pixels, &mask);
+				const long frameSize = fh->width * fh->height;
+
+				if (fh->maskOffset == 0)							// frame has no mask (only drawn unmasked)
+					mask = nil;
+
+					/* VALIDATE FRAME DATA */
+
+				GAME_ASSERT(fh->width >= 0 && fh->height >= 0);
+				GAME_ASSERT(frameSize == 0 || HandleBoundsCheck(shapeTableHandle, (Ptr) (pixels + frameSize - 1)));
+				GAME_ASSERT(frameSize == 0 || !mask || HandleBoundsCheck(shapeTableHandle, (Ptr) (mask + frameSize - 1)));
+
+					/* INTERLEAVE PIXEL & MASK ROWS */
+
+				long rowBytes = fh->width;
+				const uint8_t* framePixels = pixels;
+				const uint8_t* frameMask = mask;
+
+				if (gInterleaveShapes)
+				{
+					long paddedWidth = (fh->width + INTERLEAVE_ALIGN-1) & ~(INTERLEAVE_ALIGN-1);
+					rowBytes = mask? 2*paddedWidth: paddedWidth;
+					GAME_ASSERT(rowBytes <= 0x7FFF);
+
+					if (pass == 1)
+					{
+						uint8_t* out = interleavedData + interleavedBytes;
+						memset(out, 0, rowBytes * fh->height);					// zero the padding
+
+						framePixels = out;
+						frameMask = mask? out + paddedWidth: nil;
+
+						for (int row = 0; row < fh->height; row++)
+						{
+							memcpy(out + row*rowBytes, pixels + row*fh->width, fh->width);
+							if (mask)
+								memcpy(out + row*rowBytes + paddedWidth, mask + row*fh->width, fh->width);
+						}
+					}
+
+					interleavedBytes += rowBytes * fh->height;
+				}
+
+					/* COMPILE SPANS */
+					//
+					// Each frame's span data is its row table (height+1 entries,
+					// relative to the frame's first span) followed by the spans.
+					//
+
+				int32_t*	rowSpans = nil;
+				SpriteSpan*	spans = nil;
+				int32_t		numSpans = 0;
+
+				if (pass == 1)
+				{
+					rowSpans = (int32_t*) (spanData + spanBytes);
+					spans = (SpriteSpan*) (rowSpans + fh->height + 1);
+				}
+
+				for (int row = 0; row < fh->height; row++)
+				{
+					if (pass == 1)
+						rowSpans[row] = numSpans;
+
+					numSpans += CompileSpanRow(
+							pixels + row*fh->width,
+							mask? mask + row*fh->width: nil,
+							fh->width,
+							pass == 1? spans + numSpans: nil);
+				}
+
+				if (pass == 1)
+				{
+					rowSpans[fh->height] = numSpans;					// sentinel closes the last row
+
+					FrameDescriptor* fd = &table->frames[numFrames];
+					fd->width			= fh->width;
+					fd->height			= fh->height;
+					fd->x				= fh->x;
+					fd->y				= fh->y;
+					fd->rowBytes		= rowBytes;
+					fd->unused			= 0;
+					fd->rowSpansOffset	= (int32_t) ((uint8_t*) rowSpans - (uint8_t*) fd);
+					fd->pixels			= framePixels;
+					fd->mask			= frameMask;
+				}
+
+				long frameSpanBytes = (fh->height + 1) * sizeof(int32_t) + numSpans * sizeof(SpriteSpan);
+				spanBytes += (frameSpanBytes + 3) & ~3;						// keep the next row table aligned
+				numFrames++;
+			}
+		}
+	}
+
+				/* TALLY MEMORY FOR THE STATS LINE */
+
+	table->dataBytes = (long) GetHandleSize(shapeTableHandle);
+	table->tableBytes = table->dataBytes + (long) (numFrames*sizeof(FrameDescriptor)) + spanBytes + interleavedBytes;
+	gShapeDataBytes += table->dataBytes;
+	gShapeTableBytes += table->tableBytes;
+
+#if _DEBUG
+	VerifyFrameTable(groupNum);
+#endif
+}
+
 /************************ DRAW FRAME TO GENERIC BUFFER ********************/
 
 static void DrawFrameToBuffer(
@@ -289,21 +795,12 @@ static void DrawFrameToBuffer(
 		int destBufferHeight
 		)
 {
-					/* CALC ADDRESS OF FRAME TO DRAW */
+					/* GET FRAME TO DRAW */
 
-	const uint8_t*	pixelData	= nil;
-	const uint8_t*	maskData	= nil;
+	const FrameDescriptor* fd = GetFrameDescriptor(groupNum, shapeNum, frameNum);
 
-	const FrameHeader* fh = GetFrameHeader(
-			groupNum,
-			shapeNum,
-			frameNum,
-			&pixelData,
-			mask? &maskData: nil
-	);
-
-	x += fh->x;										// use position offsets
-	y += fh->y;
+	x += fd->x;										// use position offsets
+	y += fd->y;
 
 	x += gScreenXOffset;							// global centering offset
 	y += gScreenYOffset;
@@ -314,36 +811,30 @@ static void DrawFrameToBuffer(
 
 	uint8_t* destPtr = destBuffer + y*destBufferWidth + x;
 
+	if (destBuffer == gIndexedFramebuffer)			// let the present code know which rows changed
+		MarkFramebufferRowsDirty(y, fd->height);
+
 						/* DO THE DRAW */
 
 	if (!mask)
 	{
-		for (int row = fh->height; row; row--)
+		const uint8_t* pixelData = fd->pixels;
+
+		for (int row = fd->height; row; row--)
 		{
-			memcpy(destPtr, pixelData, fh->width);
+			memcpy(destPtr, pixelData, fd->width);
 
 			destPtr += destBufferWidth;				// next row
-			pixelData += fh->width;
+			pixelData += fd->rowBytes;
 		}
 	}
 	else
 	{
-		const uint32_t* srcPtr32	= (const uint32_t*) pixelData;
-		const uint32_t* maskPtr32	= (const uint32_t*) maskData;
-
-		for (int row = fh->height; row; row--)
+		for (int row = 0; row < fd->height; row++)
 		{
-			uint32_t* destPtr32 = (uint32_t*) destPtr;		// get line start ptr
+			DrawSpanRow(destPtr, nil, fd, row, 0, fd->width);
 
-			for (int col = fh->width >> 2; col; col--)
-			{
-				*destPtr32 = (*destPtr32 & *maskPtr32) | (*srcPtr32);
-				destPtr32++;
-				maskPtr32++;
-				srcPtr32++;
-			}
-
-			destPtr += destBufferWidth;			// next row
+			destPtr += destBufferWidth;				// next row
 		}
 	}
 }
@@ -438,6 +929,8 @@ long	i,i2;
 
 			// Clear pointers to shapes so the game will segfault if inadvertantly reusing zombie shapes
 			memset(gSHAPE_HEADER_Ptrs[i], 0, sizeof(gSHAPE_HEADER_Ptrs[i]));
+
+			DisposeFrameTable(i);
 		}
 	}
 }
@@ -469,6 +962,46 @@ long	x2;
 }
 
 
+/************************ GET NODE FRAME DESCRIPTOR ********************/
+//
+// The descriptor is cached in the node whenever its frame changes,
+// so drawing doesn't have to look it up again.
+//
+
+static inline const FrameDescriptor* GetNodeFrameDescriptor(const ObjNode* theNodePtr)
+{
+	const FrameDescriptor* fd = theNodePtr->FrameDesc;
+
+	GAME_ASSERT_MESSAGE(fd, "Illegal Frame #");
+
+#if _DEBUG
+	GAME_ASSERT_MESSAGE(fd == FindFrameDescriptor(theNodePtr->SpriteGroupNum, theNodePtr->Type, theNodePtr->CurrentFrame),
+						"Stale frame descriptor");
+#endif
+
+	return fd;
+}
+
+
+/************************ DRAW SPRITE RECT ********************/
+
+static void DrawSpriteRect(const SpriteDraw* draw)
+{
+	if (draw->numRows <= 0 || draw->colEnd <= draw->colStart)
+		return;
+
+	for (int y = draw->destY; y < draw->destY + draw->numRows; y++)
+	{
+		DrawSpanRow(
+				draw->destRows[y] + draw->destX,
+				draw->tileMaskRows? draw->tileMaskRows[y] + draw->destX: nil,
+				draw->fd,
+				draw->frameRow + (y - draw->destY),
+				draw->colStart,
+				draw->colEnd);
+	}
+}
+
 /************************ DRAW A SPRITE ********************/
 //
 // Normal draw routine to draw a sprite Object
@@ -477,15 +1010,9 @@ long	x2;
 void DrawASprite(ObjNode *theNodePtr)
 {
 int32_t	width;
-int32_t	*destPtr32;
-const int32_t*			maskPtr32;
-const int32_t*			srcPtr32;
 int32_t	height;
-int32_t	*destStartPtr32;
-int32_t	frameNum;
 int32_t	x,y,offset;
 Rect	oldBox;
-int32_t	shapeNum,groupNum;
 
 	if (theNodePtr->PFCoordsFlag)					// see if do special PF Draw code
 	{
@@ -493,27 +1020,19 @@ int32_t	shapeNum,groupNum;
 		return;
 	}
 
-	groupNum = theNodePtr->SpriteGroupNum;			// get shape group #
-	shapeNum = theNodePtr->Type;					// get shape type
-	frameNum = theNodePtr->CurrentFrame;			// get frame #
 	x = (theNodePtr->X.Int);						// get short x coord
 	y = (theNodePtr->Y.Int);						// get short y coord
 
-					/* CALC ADDRESS OF FRAME TO DRAW */
+					/* GET FRAME TO DRAW */
 
-	const FrameHeader* fh = GetFrameHeader(
-			groupNum,
-			shapeNum,
-			frameNum,
-			(const uint8_t**) &srcPtr32,
-			(const uint8_t**) &maskPtr32
-	);
+	const FrameDescriptor* fd = GetNodeFrameDescriptor(theNodePtr);
 
-	width = fh->width >> 2;							// get word width
-	height = fh->height;							// get height
+	width = fd->width;								// get pixel width
+	height = fd->height;							// get height
+	offset = 0;										// first frame row to draw
 
-	x += fh->x;										// use position offsets
-	y += fh->y;
+	x += fd->x;										// use position offsets
+	y += fd->y;
 
 	x += gScreenXOffset;							// global centering offset
 	y += gScreenYOffset;
@@ -521,7 +1040,7 @@ int32_t	shapeNum,groupNum;
 	oldBox = theNodePtr->drawBox;						// remember old box
 
 	if ((x < gRegionClipLeft[theNodePtr->ClipNum]) ||		// see if out of bounds
-		((x+(width<<2)) >= gRegionClipRight[theNodePtr->ClipNum]) ||
+		((x+width) >= gRegionClipRight[theNodePtr->ClipNum]) ||
 		((y+height) <= gRegionClipTop[theNodePtr->ClipNum]) ||
 		(y >= gRegionClipBottom[theNodePtr->ClipNum]))
 			goto update;
@@ -534,38 +1053,32 @@ int32_t	shapeNum,groupNum;
 		offset = gRegionClipTop[theNodePtr->ClipNum]-y;
 		y = gRegionClipTop[theNodePtr->ClipNum];
 		height -= offset;
-		srcPtr32 += offset*width;
-		maskPtr32 += offset*width;
 	}
 
 	if (theNodePtr->UpdateBoxFlag)						// see if using update regions
 	{
 		theNodePtr->drawBox.left = x;					// set drawn box
-		theNodePtr->drawBox.right = x+(width<<2)-1;		// pixel widths
+		theNodePtr->drawBox.right = x+width-1;			// pixel widths
 		theNodePtr->drawBox.top = y;
 		theNodePtr->drawBox.bottom = y+height;
 	}
 
-	destStartPtr32 = (int32_t *)(gOffScreenLookUpTable[y]+x);	// calc draw addr
-
 						/* DO THE DRAW */
-	if (height <= 0)										// special check for illegal heights
-		height = 1;
 
-	do
+	SpriteDraw draw =
 	{
-		destPtr32 = destStartPtr32;								// get line start ptr
-
-		for (int i = width; i; i--)
-		{
-			*destPtr32 = (*destPtr32 & *maskPtr32) | (*srcPtr32);
-			destPtr32++;
-			srcPtr32++;
-			maskPtr32++;
-		}
+		.fd				= fd,
+		.destRows		= gOffScreenLookUpTable,
+		.tileMaskRows	= nil,
+		.destX			= x,
+		.destY			= y,
+		.numRows		= height,
+		.frameRow		= offset,
+		.colStart		= 0,
+		.colEnd			= width,
+	};
 
-		destStartPtr32 += (OFFSCREEN_WIDTH>>2);				// next row
-	} while(--height);
+	DrawSpriteRect(&draw);
 
 
 					/* MAKE AN UPDATE REGION */
@@ -593,9 +1106,9 @@ update:
 
 void EraseASprite(ObjNode *theNodePtr)
 {
-	if (theNodePtr->PFCoordsFlag)					// see if do special PF Erase code
+	if (theNodePtr->PFCoordsFlag)					// PF sprites are restored by RestoreDirtyPFTiles
 	{
-		ErasePFSprite(theNodePtr);
+		gPFRectEraseBytes += theNodePtr->drawBox.right * theNodePtr->drawBox.bottom;	// right = width, bottom = height
 		return;
 	}
 
@@ -635,43 +1148,24 @@ void EraseASprite(ObjNode *theNodePtr)
 
 static void DrawPFSprite(ObjNode *theNodePtr)
 {
-long	width,height,i;
-long	drawHeight;
-Ptr		destPtrB,srcPtrB,maskPtrB;
-int32_t	*destPtr,*srcPtr,*maskPtr;
-Ptr		tileMaskStartPtr;
-int32_t	*tileMaskPtr;
-Ptr		destStartPtr,srcStartPtr,originalSrcStartPtr;
-Ptr		originalMaskStartPtr,maskStartPtr;
-long	frameNum;
-long	realWidth,originalY,topToClip,leftToClip;
-long	drawWidth,shapeNum,groupNum,numHSegs;
+long	width,height;
+long	originalY,topToClip,leftToClip;
+long	drawWidth,numHSegs;
 Boolean	priorityFlag;
-Ptr		tmP;
 int32_t	x, y;
 
-	groupNum = theNodePtr->SpriteGroupNum;				// get shape group #
-	shapeNum = theNodePtr->Type;						// get shape type
-	frameNum = theNodePtr->CurrentFrame;				// get frame #
-
 					/* GET OBJECT POSITION (INTERPOLATED IN FRAMERATE-INDEPENDENT MODE)  */
 
 	TweenObjectPosition(theNodePtr, &x, &y);
 
-					/* CALC ADDRESS OF FRAME TO DRAW */
+					/* GET FRAME TO DRAW */
 
-	const FrameHeader* fh = GetFrameHeader(
-			groupNum,
-			shapeNum,
-			frameNum,
-			(const uint8_t**) &srcStartPtr,
-			(const uint8_t**) &maskStartPtr
-	);
+	const FrameDescriptor* fd = GetNodeFrameDescriptor(theNodePtr);
 
-	drawWidth = realWidth = width = fh->width;		// get pixel width
-	height = fh->height;							// get height
-	x += fh->x;										// use position offsets (still global coords)
-	y += fh->y;
+	drawWidth = width = fd->width;					// get pixel width
+	height = fd->height;							// get height
+	x += fd->x;										// use position offsets (still global coords)
+	y += fd->y;
 
 				/************************/
 				/*  CHECK IF VISIBLE    */
@@ -743,210 +1237,122 @@ int32_t	x, y;
 	else
 		numHSegs = 1;
 
-	leftToClip += (topToClip*realWidth);
-	srcStartPtr += leftToClip;
-	maskStartPtr += leftToClip;
-	originalSrcStartPtr = srcStartPtr;	 						// get ptr to PIXEL_DATA
-	originalMaskStartPtr = maskStartPtr; 						// get ptr to MASK_DATA
-
-	destStartPtr = (Ptr)(gPFLookUpTable[y]+x);					// calc draw addr
-
 						/* DO THE DRAW */
+						//
+						// Each horizontal segment is split again where it wraps
+						// vertically, so every piece is a plain rectangle.
+						//
 
-
-	if (!priorityFlag)
+	SpriteDraw draw =
 	{
-		for (; numHSegs > 0; numHSegs--)
-		{
-			for (drawHeight = 0; drawHeight < height; drawHeight++)
-			{
-				destPtr = (int32_t *)destStartPtr;					// get line start ptr
-				srcPtr = (int32_t *)srcStartPtr;
-				maskPtr = (int32_t *)maskStartPtr;
+		.fd				= fd,
+		.destRows		= (uint8_t* const*) gPFLookUpTable,
+		.tileMaskRows	= priorityFlag? (uint8_t* const*) gPFMaskLookUpTable: nil,
+	};
 
-				for (i=(width>>2); i ; i--)					// draw longs
-				{
-					*destPtr = (*destPtr & (*maskPtr++)) | (*srcPtr++);
-					destPtr++;
-				}
+	for (; numHSegs > 0; numHSegs--)
+	{
+		long rowsBeforeWrap = PF_BUFFER_HEIGHT - originalY;
+		if (rowsBeforeWrap > height)
+			rowsBeforeWrap = height;
 
-				destPtrB = (Ptr)destPtr;
-				maskPtrB = (Ptr)maskPtr;
-				srcPtrB = (Ptr)srcPtr;
-				for (i=(width&0b11); i; i--)						// draw remaining pixels
-				{
-					*destPtrB = (*destPtrB & (*maskPtrB++)) | (*srcPtrB++);
-					destPtrB++;
-				}
+		draw.destX		= x;
+		draw.colStart	= leftToClip;
+		draw.colEnd		= leftToClip + width;
 
-				srcStartPtr += realWidth;						// next sprite line
-				maskStartPtr += realWidth;						// next mask line
+		draw.destY		= originalY;
+		draw.numRows	= rowsBeforeWrap;
+		draw.frameRow	= topToClip;
+		DrawSpriteRect(&draw);
 
-				if (++y >=  PF_BUFFER_HEIGHT)					// see if wrap buffer vertically
-				{
-					destStartPtr = (Ptr)(gPFLookUpTable[0]+x);	// wrap to top
-					y = 0;
-				}
-				else
-					destStartPtr += PF_BUFFER_WIDTH;			// next buffer line
-			}
+		draw.destY		= 0;							// wrapped part at top of buffer
+		draw.numRows	= height - rowsBeforeWrap;
+		draw.frameRow	= topToClip + rowsBeforeWrap;
+		DrawSpriteRect(&draw);
 
-			if (numHSegs == 2)
-			{
-				destStartPtr = (Ptr)gPFLookUpTable[y = originalY];	// set buff addr for segment #2
-				x = 0;
-				srcStartPtr = originalSrcStartPtr+width;
-				maskStartPtr = originalMaskStartPtr+width;
-				width = drawWidth-width;
-			}
+		if (theNodePtr->EraseFlag)						// have EraseObjects restore what we drew over
+		{
+			MarkDirtyPFTiles(x, originalY, width, rowsBeforeWrap);
+			MarkDirtyPFTiles(x, 0, width, height - rowsBeforeWrap);
 		}
-	}
-	else
-	{
-					/**************************/
-					/* DRAW IT WITH TILE MASK */
-					/**************************/
 
-		tileMaskStartPtr = (Ptr)(gPFMaskLookUpTable[y]+x);			// calc tilemask addr
-
-		for (; numHSegs > 0; numHSegs--)
+		if (numHSegs == 2)
 		{
-			for (drawHeight = 0; drawHeight < height; drawHeight++)
-			{
-				destPtr = (int32_t *)destStartPtr;								// get line start ptr
-				srcPtr = (int32_t *)srcStartPtr;
-				maskPtr = (int32_t *)maskStartPtr;
-				tileMaskPtr = (int32_t *)tileMaskStartPtr;
-
-				for (i=(width>>2); i ; i--)
-				{
-					*destPtr =   (*destPtr & (*maskPtr | *tileMaskPtr)) |		// draw longs
-								 (*srcPtr & (*tileMaskPtr ^ 0xffffffffL));
-					destPtr++;
-					tileMaskPtr++;
-					maskPtr++;
-					srcPtr++;
-				}
-
-				tmP = (Ptr)tileMaskPtr;
-				destPtrB = (Ptr)destPtr;
-				maskPtrB = (Ptr)maskPtr;
-				srcPtrB = (Ptr)srcPtr;
-				for (i=(width&0b11); i; i--)						// draw remaining pixels
-				{
-					*destPtrB =  (*destPtrB & (*maskPtrB | *tmP)) |
-								 (*srcPtrB & (*tmP ^ 0xff));
-					destPtrB++;
-					maskPtrB++;
-					srcPtrB++;
-					tmP++;
-				}
-
-				srcStartPtr += realWidth;						// next sprite line
-				maskStartPtr += realWidth;						// next mask line
-
-				if (++y >=  PF_BUFFER_HEIGHT)					// see if wrap buffer vertically
-				{
-					destStartPtr = (Ptr)(gPFLookUpTable[0]+x);	// wrap to top
-					tileMaskStartPtr = (Ptr)(gPFMaskLookUpTable[0]+x);
-					y = 0;
-				}
-				else
-				{
-					destStartPtr += PF_BUFFER_WIDTH;			// next buffer line
-					tileMaskStartPtr += PF_BUFFER_WIDTH;
-				}
-			}
-
-			if (numHSegs == 2)
-			{
-				destStartPtr = (Ptr)gPFLookUpTable[originalY];		// set buff addr for segment #2
-				tileMaskStartPtr = (Ptr)gPFMaskLookUpTable[y = originalY];
-				x = 0;
-				srcStartPtr = originalSrcStartPtr+width;
-				maskStartPtr = originalMaskStartPtr+width;
-				width = drawWidth-width;
-			}
+			x = 0;										// segment #2 starts at left of buffer
+			leftToClip += width;						// and picks up where #1 left off
+			width = drawWidth-width;
 		}
 	}
 }
 
-/************************ ERASE PLAYFIELD SPRITE ********************/
+/************************ MARK DIRTY PF TILES ********************/
+//
+// Flags the PF buffer tiles under a non-wrapping rectangle.
+//
 
-static void ErasePFSprite(ObjNode *theNodePtr)
+static void MarkDirtyPFTiles(long x, long y, long width, long height)
 {
-long	width,height,drawWidth,y;
-long	i;
-uint64_t	*destPtr;
-const uint64_t *srcPtr;
-Ptr		destPtrB,srcPtrB;
-Ptr		destStartPtr;
-Ptr		srcStartPtr,originalSrcStartPtr;
-long	x;
-long	numHSegs;
-long	drawHeight,originalY;
-
-	x = theNodePtr->drawBox.left;					// remember area in the drawbox
-	drawWidth = width = theNodePtr->drawBox.right;	// right actually = width
-	originalY = y = theNodePtr->drawBox.top;
-	height = theNodePtr->drawBox.bottom;
-
-	if ((height <= 0) || (width <= 0))							// see if anything there
+	if (width <= 0 || height <= 0)
 		return;
 
-	if ((x+width) >= PF_BUFFER_WIDTH)				// check horiz clipping
-	{
-		width -= ((x+width)-PF_BUFFER_WIDTH);
-		numHSegs = 2;								// 2 horiz segments
-	}
-	else
-		numHSegs = 1;
+	long col2 = (x + width - 1) >> TILE_SIZE_SH;
+	long row2 = (y + height - 1) >> TILE_SIZE_SH;
 
+	for (long row = y >> TILE_SIZE_SH; row <= row2; row++)
+	{
+		uint64_t* bits = gPFDirtyTiles + row * gPFDirtyTileWords;
 
-	destStartPtr = (Ptr)(gPFLookUpTable[y]+x);				// calc draw addr
-	originalSrcStartPtr = srcStartPtr = (Ptr)(gPFCopyLookUpTable[y]+x);	// calc source addr
+		for (long col = x >> TILE_SIZE_SH; col <= col2; col++)
+			bits[col >> 6] |= 1ull << (col & 63);
+	}
+}
 
-						/* DO THE ERASE */
+/************************ RESTORE DIRTY PF TILES ********************/
+//
+// Erases all PF sprites at once by copying every dirty tile back from the PF copy buffer.
+// Overlapping sprites in a crowd share tiles, so each pixel is restored at most once,
+// and runs of dirty tiles in a tile row go out as one wide, tile-aligned copy per line.
+//
 
-	for (; numHSegs > 0; numHSegs--)
+void RestoreDirtyPFTiles(void)
+{
+	for (long row = 0; row < PF_TILE_HEIGHT; row++)
 	{
-		for (drawHeight = 0; drawHeight < height; drawHeight++)
-		{
-			destPtr = (uint64_t *)destStartPtr;					// get line start ptr
-			srcPtr = (const uint64_t *)srcStartPtr;
+		uint64_t* bits = gPFDirtyTiles + row * gPFDirtyTileWords;
+		uint64_t any = 0;
 
-			for (i=(width>>3); i ; i--)
-				*destPtr++ = *srcPtr++;							// erase doubles
+		for (int w = 0; w < gPFDirtyTileWords; w++)
+			any |= bits[w];
 
+		if (!any)
+			continue;
 
-			destPtrB = (Ptr)destPtr;
-			srcPtrB = (Ptr)srcPtr;
+		long col = 0;
+		while (col < PF_TILE_WIDTH)
+		{
+			if (!(bits[col >> 6] & (1ull << (col & 63))))
+			{
+				col++;
+				continue;
+			}
 
+			long firstCol = col;									// find run of dirty tiles
+			while (col < PF_TILE_WIDTH && (bits[col >> 6] & (1ull << (col & 63))))
+				col++;
 
-			for (i = (width & 0b111) - 1; i >= 0; i--)				// do remaining pixels
-				destPtrB[i] = srcPtrB[i];
+			long left = firstCol << TILE_SIZE_SH;
+			long width = (col - firstCol) << TILE_SIZE_SH;
+			long top = row << TILE_SIZE_SH;
 
-			if (++y >=  PF_BUFFER_HEIGHT)					// see if wrap buffer vertically
-			{
-				destStartPtr = (Ptr)(gPFLookUpTable[0]+x);	// wrap to top
-				srcStartPtr = (Ptr)(gPFCopyLookUpTable[0]+x);
-				y = 0;
-			}
-			else
+			for (int y = top; y < top + TILE_SIZE; y++)
 			{
-				destStartPtr += PF_BUFFER_WIDTH;			// next buffer line
-				srcStartPtr += PF_BUFFER_WIDTH;
+				memcpy(gPFLookUpTable[y] + left, gPFCopyLookUpTable[y] + left, width);
 			}
-		}
 
-		if (numHSegs == 2)
-		{
-			destStartPtr = (Ptr)gPFLookUpTable[originalY];		// set buff addr for segment #2
-			srcStartPtr = (Ptr)gPFCopyLookUpTable[originalY];
-			y = originalY;
-			x = 0;
-			width = drawWidth-width;
+			gPFTileEraseBytes += width * TILE_SIZE;
 		}
+
+		memset(bits, 0, gPFDirtyTileWords * sizeof(uint64_t));
 	}
 }
 
@@ -0,0 +1,237 @@
+// SPRITE BLIT KERNELS
+// This file is part of Mighty Mike. https://github.com/jorio/mightymike
+//
+// SIMD versions of the masked span blits that Shape.c uses to draw sprites.
+// Opaque spans without a tile mask never come through here -- those are plain memcpys.
+// All loads/stores are unaligned; whatever doesn't fill a whole vector at the end
+// of a span falls through to the next narrower kernel, down to the scalar loop.
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define BLIT_X86 1
+	#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	#define BLIT_NEON 1
+	#include <arm_neon.h>
+#endif
+
+#if BLIT_X86 && (defined(__GNUC__) || defined(__clang__))
+	#define TARGET_SSE2 __attribute__((target("sse2")))
+	#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+	#define TARGET_SSE2
+	#define TARGET_AVX2
+#endif
+
+#include "externs.h"
+#include "misc.h"
+#include "spriteblit.h"
+
+MaskedSpanKernel		gBlitMaskedSpan = nil;
+TileMaskedSpanKernel	gBlitTileMaskedSpan = nil;
+
+// ----------------------------------------------------------------------------
+// Scalar
+
+static void BlitMaskedSpan_Scalar(uint8_t* dest, const uint8_t* pixels, const uint8_t* mask, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		dest[i] = (dest[i] & mask[i]) | pixels[i];
+	}
+}
+
+static void BlitTileMaskedSpan_Scalar(uint8_t* dest, const uint8_t* tileMask, const uint8_t* pixels, const uint8_t* mask, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		uint8_t m = mask? mask[i]: 0x00;
+		dest[i] = (dest[i] & (m | tileMask[i])) | (pixels[i] & ~tileMask[i]);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// SSE2 & AVX2
+
+#if BLIT_X86
+TARGET_SSE2
+static void BlitMaskedSpan_SSE2(uint8_t* dest, const uint8_t* pixels, const uint8_t* mask, int count)
+{
+	int i = 0;
+
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i*) (dest + i));
+		__m128i s = _mm_loadu_si128((const __m128i*) (pixels + i));
+		__m128i m = _mm_loadu_si128((const __m128i*) (mask + i));
+		_mm_storeu_si128((__m128i*) (dest + i), _mm_or_si128(_mm_and_si128(d, m), s));
+	}
+
+	BlitMaskedSpan_Scalar(dest + i, pixels + i, mask + i, count - i);
+}
+
+TARGET_SSE2
+static void BlitTileMaskedSpan_SSE2(uint8_t* dest, const uint8_t* tileMask, const uint8_t* pixels, const uint8_t* mask, int count)
+{
+	int i = 0;
+
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i*) (dest + i));
+		__m128i s = _mm_loadu_si128((const __m128i*) (pixels + i));
+		__m128i t = _mm_loadu_si128((const __m128i*) (tileMask + i));
+		__m128i keep = mask? _mm_or_si128(_mm_loadu_si128((const __m128i*) (mask + i)), t): t;
+		_mm_storeu_si128((__m128i*) (dest + i), _mm_or_si128(_mm_and_si128(d, keep), _mm_andnot_si128(t, s)));
+	}
+
+	BlitTileMaskedSpan_Scalar(dest + i, tileMask + i, pixels + i, mask? mask + i: nil, count - i);
+}
+
+TARGET_AVX2
+static void BlitMaskedSpan_AVX2(uint8_t* dest, const uint8_t* pixels, const uint8_t* mask, int count)
+{
+	int i = 0;
+
+	for (; i + 32 <= count; i += 32)
+	{
+		__m256i d = _mm256_loadu_si256((const __m256i*) (dest + i));
+		__m256i s = _mm256_loadu_si256((const __m256i*) (pixels + i));
+		__m256i m = _mm256_loadu_si256((const __m256i*) (mask + i));
+		_mm256_storeu_si256((__m256i*) (dest + i), _mm256_or_si256(_mm256_and_si256(d, m), s));
+	}
+
+	BlitMaskedSpan_SSE2(dest + i, pixels + i, mask + i, count - i);
+}
+
+TARGET_AVX2
+static void BlitTileMaskedSpan_AVX2(uint8_t* dest, const uint8_t* tileMask, const uint8_t* pixels, const uint8_t* mask, int count)
+{
+	int i = 0;
+
+	for (; i + 32 <= count; i += 32)
+	{
+		__m256i d = _mm256_loadu_si256((const __m256i*) (dest + i));
+		__m256i s = _mm256_loadu_si256((const __m256i*) (pixels + i));
+		__m256i t = _mm256_loadu_si256((const __m256i*) (tileMask + i));
+		__m256i keep = mask? _mm256_or_si256(_mm256_loadu_si256((const __m256i*) (mask + i)), t): t;
+		_mm256_storeu_si256((__m256i*) (dest + i), _mm256_or_si256(_mm256_and_si256(d, keep), _mm256_andnot_si256(t, s)));
+	}
+
+	BlitTileMaskedSpan_SSE2(dest + i, tileMask + i, pixels + i, mask? mask + i: nil, count - i);
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// NEON
+
+#if BLIT_NEON
+static void BlitMaskedSpan_NEON(uint8_t* dest, const uint8_t* pixels, const uint8_t* mask, int count)
+{
+	int i = 0;
+
+	for (; i + 16 <= count; i += 16)
+	{
+		uint8x16_t d = vld1q_u8(dest + i);
+		uint8x16_t s = vld1q_u8(pixels + i);
+		uint8x16_t m = vld1q_u8(mask + i);
+		vst1q_u8(dest + i, vorrq_u8(vandq_u8(d, m), s));
+	}
+
+	BlitMaskedSpan_Scalar(dest + i, pixels + i, mask + i, count - i);
+}
+
+static void BlitTileMaskedSpan_NEON(uint8_t* dest, const uint8_t* tileMask, const uint8_t* pixels, const uint8_t* mask, int count)
+{
+	int i = 0;
+
+	for (; i + 16 <= count; i += 16)
+	{
+		uint8x16_t d = vld1q_u8(dest + i);
+		uint8x16_t s = vld1q_u8(pixels + i);
+		uint8x16_t t = vld1q_u8(tileMask + i);
+		uint8x16_t keep = mask? vorrq_u8(vld1q_u8(mask + i), t): t;
+		vst1q_u8(dest + i, vorrq_u8(vandq_u8(d, keep), vbicq_u8(s, t)));		// vbic = s & ~t
+	}
+
+	BlitTileMaskedSpan_Scalar(dest + i, tileMask + i, pixels + i, mask? mask + i: nil, count - i);
+}
+#endif
+
+// ----------------------------------------------------------------------------
+
+#if _DEBUG
+static void VerifySpriteBlitKernels(void)
+{
+	enum { kCount = 256 + 13 };					// odd, so the scalar tails get exercised too
+
+	uint8_t background[kCount];
+	uint8_t tileMask[kCount];
+	uint8_t pixels[kCount];
+	uint8_t mask[kCount];
+	uint8_t expected[kCount];
+	uint8_t actual[kCount];
+
+	uint32_t seed = 0x53707269;
+	for (int i = 0; i < kCount; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		background[i]	= seed >> 24;
+		pixels[i]		= seed >> 16;
+		mask[i]			= (seed & 0x100)? 0xFF: (seed >> 8);
+		tileMask[i]		= (seed & 0x200)? 0xFF: 0x00;
+	}
+
+	for (int start = 0; start < 32; start++)		// unaligned starting points
+	{
+		for (int count = 0; start + count <= kCount; count += 1 + count / 8)
+		{
+			memcpy(expected, background, kCount);
+			memcpy(actual, background, kCount);
+			BlitMaskedSpan_Scalar(expected + start, pixels + start, mask + start, count);
+			gBlitMaskedSpan(actual + start, pixels + start, mask + start, count);
+			GAME_ASSERT_MESSAGE(0 == memcmp(expected, actual, kCount), "Masked span kernel mismatch");
+
+			for (int opaque = 0; opaque < 2; opaque++)
+			{
+				const uint8_t* m = opaque? nil: mask + start;
+
+				memcpy(expected, background, kCount);
+				memcpy(actual, background, kCount);
+				BlitTileMaskedSpan_Scalar(expected + start, tileMask + start, pixels + start, m, count);
+				gBlitTileMaskedSpan(actual + start, tileMask + start, pixels + start, m, count);
+				GAME_ASSERT_MESSAGE(0 == memcmp(expected, actual, kCount), "Tile-masked span kernel mismatch");
+			}
+		}
+	}
+}
+#endif
+
+void InitSpriteBlitKernels(void)
+{
+	gBlitMaskedSpan = BlitMaskedSpan_Scalar;
+	gBlitTileMaskedSpan = BlitTileMaskedSpan_Scalar;
+
+#if BLIT_X86
+	if (SDL_HasAVX2())
+	{
+		gBlitMaskedSpan = BlitMaskedSpan_AVX2;
+		gBlitTileMaskedSpan = BlitTileMaskedSpan_AVX2;
+	}
+	else if (SDL_HasSSE2())
+	{
+		gBlitMaskedSpan = BlitMaskedSpan_SSE2;
+		gBlitTileMaskedSpan = BlitTileMaskedSpan_SSE2;
+	}
+#elif BLIT_NEON
+	if (SDL_HasNEON())
+	{
+		gBlitMaskedSpan = BlitMaskedSpan_NEON;
+		gBlitTileMaskedSpan = BlitTileMaskedSpan_NEON;
+	}
+#endif
+
+#if _DEBUG
+	VerifySpriteBlitKernels();
+#endif
+}
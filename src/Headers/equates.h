@@ -120,4 +120,8 @@ enum
 	kScaling_PixelPerfect	= 0,
 	kScaling_Stretch		= 1,
 	kScaling_HQStretch		= 2,
+	kScaling_Scale2x		= 3,
+	kScaling_Scale3x		= 4,
+	kScaling_OutputInteger	= 5,		// CPU scales straight to the window's pixel size
+	kScaling_OutputBilinear	= 6,
 };
@@ -87,6 +87,12 @@ extern	struct SDL_Renderer		*gSDLRenderer;
 extern	struct SDL_Texture		*gSDLTexture;
 extern	FSSpec					gDataSpec;
 extern	int						gNumThreads;
+extern	Boolean					gHeadless;
+extern	long					gQuitAfterFrames;
+extern	Boolean					gInterleaveShapes;
+extern	Boolean					gFusedPlayfield;
+extern	long					gCustomPlayfieldWidth;
+extern	long					gCustomPlayfieldHeight;
 
 #pragma mark - MyGuy
 
@@ -217,15 +223,26 @@ extern	int						VISIBLE_HEIGHT;
 extern	uint8_t					*gIndexedFramebuffer;
 extern	uint8_t					*gRGBAFramebuffer;
 extern	uint8_t					*gRGBAFramebufferX2;
+extern	uint8_t					*gRGBAFramebufferX3;
 extern	uint8_t					**gScreenLookUpTable;		// VISIBLE_HEIGHT elements
 extern	uint8_t					**gOffScreenLookUpTable;	// OFFSCREEN_HEIGHT elements
 extern	uint8_t					**gBackgroundLookUpTable;	// OFFSCREEN_HEIGHT elements
 extern	Ptr						*gPFLookUpTable;
 extern	Ptr						*gPFCopyLookUpTable;
 extern	Ptr						*gPFMaskLookUpTable;
+extern	uint64_t				*gPFDirtyTiles;				// PF_TILE_HEIGHT rows of gPFDirtyTileWords
+extern	int						gPFDirtyTileWords;
+extern	long					gPFTileEraseBytes;			// bytes restored by RestoreDirtyPFTiles
+extern	long					gPFRectEraseBytes;			// bytes per-sprite rect erases would have copied
+extern	long					gShapeDataBytes;			// bytes of shape files loaded in all groups
+extern	long					gShapeTableBytes;			// same, plus their frame tables & interleaved rows
+extern	uint64_t				*gUpdateRegionBits;			// OFFSCREEN_HEIGHT rows of gUpdateRegionWords
+extern	int						gUpdateRegionWords;
+extern	long					gUpdateRegionBytes;			// bytes copied by DumpUpdateRegions
+extern	long					gUpdateRectBytes;			// bytes the raw update rects add up to
 extern	long					gScreenXOffset;				// global centering offset applied to sprites
 extern	long					gScreenYOffset;				// global centering offset applied to sprites
 extern	Handle					gBackgroundHandle;
 extern	Handle					gOffScreenHandle;
 extern	Handle					gPFBufferHandle;
-extern	uint8_t					*gRowDitherStrides;			// for dithering filter
+extern	uint8_t					*gFramebufferDirtyRows;		// VISIBLE_HEIGHT elements
@@ -0,0 +1,22 @@
+//
+// jobsystem.h
+//
+
+#pragma once
+
+// Work callback for ParallelFor. Processes items [begin, end).
+// workerNum is in [0, GetJobSystemWorkerCount()) and is stable for the duration of the call,
+// so it can be used to index per-worker scratch memory.
+typedef void (*JobFunc)(void* userData, int begin, int end, int workerNum);
+
+// Returned by ParallelForAsync. Every handle must eventually be passed to WaitForJob.
+typedef int JobHandle;
+enum { kJobHandle_None = -1 };
+
+void	InitJobSystem(int numWorkers);
+void	ShutdownJobSystem(void);
+int		GetJobSystemWorkerCount(void);
+void	ForwardWorkerAssert(const char* msg, const char* file, int line);	// throws on helper threads, no-op elsewhere
+void	ParallelFor(int count, int grainSize, JobFunc func, void* userData);
+JobHandle	ParallelForAsync(int count, int grainSize, JobFunc func, void* userData);
+void	WaitForJob(JobHandle job);
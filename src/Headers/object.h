@@ -31,6 +31,7 @@ void	MoveObject(void);
 void	StopObjectMovement(ObjNode *);
 void	DeactivateObjectDraw(ObjNode *);
 void	SortObjectsByY(void);
+void	RebuildObjectZIndex(void);
 void	SimpleObjectMove(void);
 void	InitYOffset(ObjNode* node, long yOffset);
 void	TweenObjectPosition(ObjNode* node, int32_t* x, int32_t* y);
@@ -80,6 +80,8 @@ struct TileAnimEntryType
 	int16_t		count;					// current speed count
 	uint8_t		index;					// index into sequence
 	TileAnimDefType	*defPtr;			// pointer to definition
+	const int32_t	*rowStart;			// [gPlayfieldTileHeight+1]: map row r's entries in mapCols are [rowStart[r], rowStart[r+1])
+	const uint16_t	*mapCols;			// map columns holding baseTile, row by row, left to right
 };
 typedef struct TileAnimEntryType TileAnimEntryType;
 
@@ -96,16 +98,15 @@ void	BuildItemList(void);
 void	ScrollPlayfield(void);
 void StopScrollingPlayfield(void);
 void	SetItemDeleteWindow(void);
-void	ScrollPlayfield_Down(void);
-void	ScrollPlayfield_Up(void);
-void	ScrollPlayfield_Right(void);
-void	ScrollPlayfield_Left(void);
 void ScanForPlayfieldItems(long top, long bottom, long left, long right);
 void	DoMyScreenScroll(void);
 void	UpdateViewWindow(void);
 Boolean	TestCoordinateRange(void);
 Boolean	TrackItem(void);
 void	DisplayPlayfield(void);
+void	CopyPlayfieldRow(long left, long top, long y);
+Boolean	TakePendingPlayfieldCopy(long* left, long* top);
+void	FlushPendingPlayfieldCopy(void);
 void	DisplayPlayfieldInterlaced(void);
 Byte	GetAlternateTileInfo(unsigned short, unsigned short);
 unsigned short	GetMapTileAttribs(unsigned short, unsigned short);
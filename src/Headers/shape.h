@@ -23,9 +23,45 @@ typedef struct FrameList
 } FrameList;
 #pragma pack(pop)
 
+// One run of non-transparent pixels in a frame row (see BuildFrameTable)
+typedef struct SpriteSpan
+{
+	uint16_t	x;						// first column of the run in the frame
+	uint16_t	width;					// # pixels in the run
+	uint16_t	opaque;					// true: copy pixels, false: apply mask
+} SpriteSpan;
+
+// Flattened view of a frame, built & validated once by LoadShapeTable.
+// Kept at 32 bytes (on 64-bit) so two descriptors fit in a cache line.
+typedef struct FrameDescriptor
+{
+	int16_t			width;
+	int16_t			height;
+	int16_t			x;					// position offsets
+	int16_t			y;
+	int16_t			rowBytes;			// distance between rows of pixels (and of mask)
+	int16_t			unused;
+	int32_t			rowSpansOffset;		// from this descriptor to its span row table
+	const uint8_t*	pixels;
+	const uint8_t*	mask;				// nil if the frame has no mask
+} FrameDescriptor;
+
+// height+1 entries: row r's spans are [rowSpans[r], rowSpans[r+1]) of GetFrameSpans
+static inline const int32_t* GetFrameRowSpans(const FrameDescriptor* fd)
+{
+	return (const int32_t*) ((const uint8_t*) fd + fd->rowSpansOffset);
+}
+
+static inline const SpriteSpan* GetFrameSpans(const FrameDescriptor* fd)
+{
+	return (const SpriteSpan*) (GetFrameRowSpans(fd) + fd->height + 1);	// spans follow the row table
+}
+
 ObjNode	*MakeNewShape(long groupNum, long type, long subType, short x, short y, short z, void (*moveCall)(void), Boolean pfRelativeFlag);
 void LoadShapeTable(const char* filename, long groupNum);
 const FrameHeader* GetFrameHeader(long groupNum, long shapeNum, long frameNum, const uint8_t** outPixelPtr, const uint8_t** outMaskPtr);
+const FrameDescriptor* FindFrameDescriptor(long groupNum, long shapeNum, long frameNum);
+const FrameDescriptor* GetFrameDescriptor(long groupNum, long shapeNum, long frameNum);
 void	DrawFrameToScreen(long, long, long, long, long);
 void	DrawFrameToScreen_NoMask(long, long, long, long, long);
 void DrawFrameToBackground(long x, long y, long groupNum, long shapeNum, long frameNum);
@@ -33,3 +69,4 @@ void	ZapShapeTable(long);
 bool	CheckFootPriority(long x, long y, long width);
 void	DrawASprite(ObjNode *);
 void	EraseASprite(ObjNode *);
+void	RestoreDirtyPFTiles(void);
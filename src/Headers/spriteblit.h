@@ -0,0 +1,20 @@
+//
+// spriteblit.h
+//
+
+#pragma once
+
+// Masked span kernels used by the sprite blitters. All pointers may be unaligned.
+// Picked at runtime for the best instruction set the CPU supports (see InitSpriteBlitKernels).
+
+// dest = (dest & mask) | pixels
+typedef void (*MaskedSpanKernel)(uint8_t* dest, const uint8_t* pixels, const uint8_t* mask, int count);
+
+// dest = (dest & (mask | tileMask)) | (pixels & ~tileMask)
+// mask may be nil for opaque spans, in which case it's treated as all zeroes.
+typedef void (*TileMaskedSpanKernel)(uint8_t* dest, const uint8_t* tileMask, const uint8_t* pixels, const uint8_t* mask, int count);
+
+extern	MaskedSpanKernel		gBlitMaskedSpan;
+extern	TileMaskedSpanKernel	gBlitTileMaskedSpan;
+
+void	InitSpriteBlitKernels(void);
@@ -79,6 +79,7 @@ struct ObjNode
 	Ptr			AnimsList;		// ptr to object's animations list. nil = none
 	long			AnimLine;		// line # in current anim
 	long			CurrentFrame;	// current frame #
+	const struct FrameDescriptor* FrameDesc;	// cached descriptor of CurrentFrame (nil if illegal frame)
 	unsigned long AnimConst;		// default "setspeed" rate
 	long		AnimCount;		// current value of rate
 	unsigned long AnimSpeed;		// amt to subtract from count/rate
@@ -281,6 +282,7 @@ struct PrefsType
 	Byte		scalingType;
 	Boolean		uncappedFramerate;
 	Boolean		filterDithering;
+	Boolean		pipelinedPresent;
 	Boolean		music;
 	Boolean		interpolateAudio;
 	Boolean		gameTitlePowerPete;
@@ -290,7 +292,7 @@ struct PrefsType
 };
 typedef struct PrefsType PrefsType;
 
-#define PREFS_MAGIC "Mighty Mike Prefs v1"
+#define PREFS_MAGIC "Mighty Mike Prefs v4"
 
 #endif
 
@@ -2,6 +2,8 @@
 // WINDOWS.h
 //
 
+#pragma once
+
 
 					/* OFFSCREEN DEFINES */
 
@@ -20,6 +22,52 @@
 #define	WINDOW_OFFSET	 ((OFFSCREEN_WINDOW_TOP*OFFSCREEN_WIDTH)+OFFSCREEN_WINDOW_LEFT)
 
 
+					/* RGBA CONVERSION OUTPUT */
+
+// Dirty row flags: 0 = clean, 1 = changed since the last present, or one of these
+enum
+{
+	kDirtyRow_Neighbor	= 2,			// unchanged, but next to a changed row (edge-aware scalers look at neighbors)
+	kDirtyRow_Uniform	= 3,			// unchanged and known to be a single color; rewritten only because the texture lock needs it
+};
+
+// Where the playfield lands in an output-sized texture (kScaling_OutputInteger/Bilinear).
+// Pixels outside the content rect are letterbox bars.
+typedef struct
+{
+	int				outputWidth;		// renderer output size in pixels
+	int				outputHeight;
+	int				contentLeft;
+	int				contentTop;
+	int				contentWidth;
+	int				contentHeight;
+	int				integerScale;		// 0 if the content is resampled bilinearly
+} OutputMapping;
+
+typedef struct
+{
+	const uint8_t*	indexed;			// VISIBLE_WIDTH * VISIBLE_HEIGHT indexed pixels to convert
+	const uint8_t*	dirtyRows;			// VISIBLE_HEIGHT flags: only rows flagged here get converted
+	const uint32_t*	palette;
+	Boolean			filterDithering;
+	int				scalingType;		// kScaling_Scale2x/3x run an edge-aware scaler, other types just repeat pixels
+
+	uint8_t*		pixels;				// RGBA output for indexed row 'firstRow' (may be write-only memory)
+	int				pitch;				// bytes per RGBA row
+	int				scale;				// each indexed pixel becomes a scale*scale block of RGBA pixels
+	int				firstRow;			// only rows within [firstRow, firstRow+numRows) get converted
+	int				numRows;
+
+	const OutputMapping* output;		// if set, resample to output size; 'pixels' then starts at output row 'firstOutputRow'
+	int				firstOutputRow;		// only output rows within [firstOutputRow, firstOutputRow+numOutputRows) get written
+	int				numOutputRows;
+
+	Boolean			fusedPlayfield;		// copy the playfield window out of the PF buffer into 'indexed' first (see DisplayPlayfield)
+	long			playfieldLeft;		// PF buffer coords of the playfield window, for CopyPlayfieldRow
+	long			playfieldTop;
+} RGBATarget;
+
+
 
 void CleanupDisplay(void);
 
@@ -33,11 +81,23 @@ void	EraseStore(void);
 void	BlankEntireScreenArea(void);
 void	SetScreenOffsetForArea(void);
 void	SetScreenOffsetFor640x480(void);
+void	MarkFramebufferRowsDirty(int top, int numRows);
+void	MarkFramebufferDirty(void);
+Boolean	IsInterlacedRow(int y);
+void	StopInterlacing(void);
 
 void PresentIndexedFramebuffer(void);
 void DumpIndexedTGA(const char* hostPath, int width, int height, const char* data);
 void SetFullscreenMode(void);
 void OnChangeIntegerScaling(void);
 
-void ConvertFramebufferToRGBA(void);
-void ShutdownRenderThreads(void);
+void FlushPresentPipeline(void);
+
+void CheckFramebufferConversionState(void);
+void GrowDirtyRowsForScaling(uint8_t* dirtyRows);
+void BeginFramebufferConversion(const RGBATarget* target);
+void FinishFramebufferConversion(void);
+void MakeOutputMapping(OutputMapping* mapping, int outputWidth, int outputHeight, Boolean bilinear);
+void GetOutputRowsForSourceRows(const OutputMapping* mapping, int top, int bottom, int* outTop, int* outBottom);
+const char* GetPaletteKernelName(void);
+const char* GetPixelPairLUTStatus(void);
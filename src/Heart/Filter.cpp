@@ -2,82 +2,498 @@
 // (C) 2021 Iliyas Jorio
 // This file is part of Mighty Mike. https://github.com/jorio/mightymike
 
-#include <thread>
-#include <mutex>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <vector>
-#include <condition_variable>
 
-#if !_WIN32
-	#include <pthread.h>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define FILTER_X86 1
+	#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	#define FILTER_NEON 1
+	#include <arm_neon.h>
+#endif
+
+#if FILTER_X86 && (defined(__GNUC__) || defined(__clang__))
+	#define TARGET_SSE2 __attribute__((target("sse2")))
+	#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+	#define TARGET_SSE2
+	#define TARGET_AVX2
 #endif
 
 extern "C"
 {
 	#include "externs.h"
 	#include "window.h"
+	#include "misc.h"
+	#include "playfield.h"
+	#include "jobsystem.h"
 }
 
-static std::vector<std::thread> gRenderThreadPool;
-static std::mutex gMutex;
-static std::condition_variable gMainToRenderers;
-static std::condition_variable gRenderersToMain;
-static bool gQuitRenderThreads = false;
-static uint32_t gLatchMask;
+static constexpr int kRowsPerTask = 8;			// granularity of conversion tasks handed to the job system
+
+// State used to produce the current contents of the RGBA framebuffer.
+// If any of this changes, every row must be reconverted.
+static GamePalette gConvertedPalette;
+static int gConvertedFilterDithering = -1;
+static int gConvertedScalingType = -1;
+
+static constexpr int kScalerWindowRows = 3;		// rolling window of source rows kept by the scalers
+static constexpr int kScratchRowsPerWorker = 4;	// scaler window + 1 row for the bilinear resampler's vertical pass
+static std::vector<uint32_t> gScratchRows;		// RGBA rows, kScratchRowsPerWorker per worker
+static std::vector<uint64_t> gScratchBits;		// dithering filter bitmasks, per worker
 
-static inline void FilterDithering_Row(const uint8_t* indexedRow, uint8_t* rowSmearFlags);
+#if _DEBUG
+static constexpr int kDitherVerifyInterval = 64;	// check one row out of this many against the reference on every present
+static int gDitherVerifyPhase = 0;
+#endif
+
+static JobHandle gConversionJob = kJobHandle_None;
 
 // ----------------------------------------------------------------------------
+// Palette expansion kernels.
+// Each kernel looks up 'count' palette indices and writes the RGBA colors to 'rgba'.
+// The kernel is picked once per process according to what the CPU supports;
+// all kernels must produce the exact same output as the scalar version.
+
+typedef void (*PaletteExpandKernel)(uint32_t* rgba, const uint8_t* indexed, int count, const uint32_t* palette);
+
+static PaletteExpandKernel	gExpandPalette = nullptr;
+static const char*			gExpandPaletteKernelName = "none";
 
-static void ConvertIndexedFramebufferToRGBA_NoFilter(int firstRow, int numRows)
+static void ExpandPalette_Scalar(uint32_t* rgba, const uint8_t* indexed, int count, const uint32_t* palette)
 {
-	uint32_t* rgba				= ((uint32_t*)gRGBAFramebuffer) + firstRow * VISIBLE_WIDTH;
-	const uint8_t* indexed		= gIndexedFramebuffer + firstRow * VISIBLE_WIDTH;
+	for (int x = 0; x < count; x++)
+	{
+		rgba[x] = palette[indexed[x]];
+	}
+}
+
+#if FILTER_X86
+TARGET_SSE2
+static void ExpandPalette_SSE2(uint32_t* rgba, const uint8_t* indexed, int count, const uint32_t* palette)
+{
+	int x = 0;
 
-	for (int y = 0; y < numRows; y++)
+	// Fetch 8 indices at once, then store 2x4 colors with unaligned 128-bit stores
+	for (; x + 8 <= count; x += 8)
 	{
-		for (int x = 0; x < VISIBLE_WIDTH; x++)
+		uint64_t eight;
+		memcpy(&eight, indexed + x, sizeof(eight));
+
+		__m128i lo = _mm_setr_epi32(
+				(int) palette[(eight      ) & 0xFF],
+				(int) palette[(eight >>  8) & 0xFF],
+				(int) palette[(eight >> 16) & 0xFF],
+				(int) palette[(eight >> 24) & 0xFF]);
+
+		__m128i hi = _mm_setr_epi32(
+				(int) palette[(eight >> 32) & 0xFF],
+				(int) palette[(eight >> 40) & 0xFF],
+				(int) palette[(eight >> 48) & 0xFF],
+				(int) palette[(eight >> 56)       ]);
+
+		_mm_storeu_si128((__m128i*) (rgba + x    ), lo);
+		_mm_storeu_si128((__m128i*) (rgba + x + 4), hi);
+	}
+
+	ExpandPalette_Scalar(rgba + x, indexed + x, count - x, palette);
+}
+
+TARGET_AVX2
+static void ExpandPalette_AVX2(uint32_t* rgba, const uint8_t* indexed, int count, const uint32_t* palette)
+{
+	int x = 0;
+
+	// Widen 8 indices to 32 bits and gather their colors in one go
+	for (; x + 16 <= count; x += 16)
+	{
+		__m256i idxLo = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (indexed + x    )));
+		__m256i idxHi = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (indexed + x + 8)));
+
+		__m256i lo = _mm256_i32gather_epi32((const int*) palette, idxLo, 4);
+		__m256i hi = _mm256_i32gather_epi32((const int*) palette, idxHi, 4);
+
+		_mm256_storeu_si256((__m256i*) (rgba + x    ), lo);
+		_mm256_storeu_si256((__m256i*) (rgba + x + 8), hi);
+	}
+
+	ExpandPalette_Scalar(rgba + x, indexed + x, count - x, palette);
+}
+#endif
+
+#if _DEBUG
+static void VerifyPaletteKernel(PaletteExpandKernel kernel, const char* name)
+{
+	// Odd count so the scalar tail of each kernel gets exercised too
+	static const int kCount = 256 * 4 + 13;
+
+	uint8_t indexed[kCount];
+	uint32_t palette[256];
+	uint32_t expected[kCount];
+	uint32_t actual[kCount];
+
+	uint32_t seed = 0x4D696B65;
+	for (int i = 0; i < 256; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		palette[i] = seed;
+	}
+	for (int i = 0; i < kCount; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		indexed[i] = (i < 256) ? i : (seed >> 24);
+	}
+
+	for (int start = 0; start < 16; start++)		// also try unaligned starting points
+	{
+		int count = kCount - start;
+		ExpandPalette_Scalar(expected, indexed + start, count, palette);
+		kernel(actual, indexed + start, count, palette);
+		GAME_ASSERT_MESSAGE(0 == memcmp(expected, actual, count * sizeof(uint32_t)), name);
+	}
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// Dithering filter.
+// Smears horizontal dither patterns (ABABAB...) into a blend of both colors.
+//
+// Instead of walking the row pixel by pixel, the kernels below build two bitmasks
+// for the row with vector compares (bit x = pixel x):
+//     middles: row[x-1] == row[x+1] && row[x] != row[x+1]   -- x is inside a dither pattern
+//     changes: row[x] != row[x+1]
+// Consecutive middles belong to the same dither stride. Two middles one pixel
+// apart also belong to the same stride if the color changes between them.
+// Strides made up of at least two middles get smeared, plus one pixel on each side.
+// The rest is 64-bit bit twiddling, so the cost no longer depends on row contents.
+//
+// FilterDithering_Row is the original state machine. The bitmask kernels must
+// match it exactly; debug builds keep checking them against it.
+
+typedef void (*FindDitherPairsKernel)(const uint8_t* row, int width, uint64_t* middles, uint64_t* changes);
+typedef void (*ExpandDitheredKernel)(uint32_t* rgba, const uint8_t* indexed, int width, const uint32_t* palette, const uint64_t* smear);
+
+static FindDitherPairsKernel	gFindDitherPairs = nullptr;
+static ExpandDitheredKernel		gExpandDithered = nullptr;
+
+static inline int GetDitherBitsWordCount(int width)
+{
+	return (width + 63) / 64;
+}
+
+static inline uint32_t BlendDitherPair(uint32_t me, uint32_t next)
+{
+	// Average R,G,B without carrying between bytes; keep my own alpha (low byte)
+	uint32_t avg = (me & next) + (((me ^ next) & 0xFEFEFEFE) >> 1);
+	return (avg & 0xFFFFFF00) | (me & 0x000000FF);
+}
+
+static inline bool IsSmeared(const uint64_t* smear, int x)
+{
+	return (smear[x >> 6] >> (x & 63)) & 1;
+}
+
+static void MarkDitherPairs(const uint8_t* row, int begin, int end, uint64_t* middles, uint64_t* changes)
+{
+	for (int x = begin; x < end; x++)
+	{
+		if (row[x] != row[x+1])
+		{
+			uint64_t bit = 1ull << (x & 63);
+			changes[x >> 6] |= bit;
+			if (row[x-1] == row[x+1])
+				middles[x >> 6] |= bit;
+		}
+	}
+}
+
+static void FindDitherPairs_Scalar(const uint8_t* row, int width, uint64_t* middles, uint64_t* changes)
+{
+	// Leftmost and rightmost pixels lack a neighbor, so they can't be middles
+	MarkDitherPairs(row, 1, width-1, middles, changes);
+}
+
+static void ExpandDitheredTail(uint32_t* rgba, const uint8_t* indexed, int begin, int width, const uint32_t* palette, const uint64_t* smear)
+{
+	for (int x = begin; x < width; x++)
+	{
+		uint32_t me = palette[indexed[x]];
+
+		if (x < width-1 && IsSmeared(smear, x))
+			me = BlendDitherPair(me, palette[indexed[x+1]]);
+
+		rgba[x] = me;
+	}
+}
+
+static void ExpandDithered_Scalar(uint32_t* rgba, const uint8_t* indexed, int width, const uint32_t* palette, const uint64_t* smear)
+{
+	ExpandDitheredTail(rgba, indexed, 0, width, palette, smear);
+}
+
+#if FILTER_X86
+TARGET_SSE2
+static void FindDitherPairs_SSE2(const uint8_t* row, int width, uint64_t* middles, uint64_t* changes)
+{
+	// First 16 pixels the slow way because pixel 0 has no left neighbor
+	int x = 16;
+	MarkDitherPairs(row, 1, std::min(x, width-1), middles, changes);
+
+	// 16 pixels at a time, as long as the last one has a right neighbor
+	for (; x + 17 <= width; x += 16)
+	{
+		__m128i prev	= _mm_loadu_si128((const __m128i*) (row + x - 1));
+		__m128i me		= _mm_loadu_si128((const __m128i*) (row + x    ));
+		__m128i next	= _mm_loadu_si128((const __m128i*) (row + x + 1));
+
+		uint64_t meIsNext	= (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(me, next));
+		uint64_t prevIsNext	= (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(prev, next));
+		uint64_t change		= ~meIsNext & 0xFFFF;
+
+		changes[x >> 6] |= change << (x & 63);
+		middles[x >> 6] |= (change & prevIsNext) << (x & 63);
+	}
+
+	MarkDitherPairs(row, x, width-1, middles, changes);
+}
+
+TARGET_SSE2
+static inline __m128i LookUp4_SSE2(const uint8_t* indexed, const uint32_t* palette)
+{
+	return _mm_setr_epi32(
+			(int) palette[indexed[0]],
+			(int) palette[indexed[1]],
+			(int) palette[indexed[2]],
+			(int) palette[indexed[3]]);
+}
+
+TARGET_SSE2
+static inline __m128i BlendDitherPairs_SSE2(__m128i me, __m128i next, uint32_t smearBits)
+{
+	// Expand 4 smear bits to 4 pixel masks, leaving out the alpha byte
+	const __m128i weights = _mm_setr_epi32(1, 2, 4, 8);
+	__m128i mask = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32((int) smearBits), weights), weights);
+	mask = _mm_andnot_si128(_mm_set1_epi32(0xFF), mask);
+
+	// _mm_avg_epu8 rounds up; take the rounding bit back off to match BlendDitherPair
+	__m128i avg = _mm_sub_epi8(_mm_avg_epu8(me, next), _mm_and_si128(_mm_xor_si128(me, next), _mm_set1_epi8(1)));
+
+	return _mm_or_si128(_mm_and_si128(mask, avg), _mm_andnot_si128(mask, me));
+}
+
+TARGET_SSE2
+static void ExpandDithered_SSE2(uint32_t* rgba, const uint8_t* indexed, int width, const uint32_t* palette, const uint64_t* smear)
+{
+	int x = 0;
+
+	// 8 pixels at a time, as long as the last one has a right neighbor
+	for (; x + 8 < width; x += 8)
+	{
+		uint32_t smearBits = (smear[x >> 6] >> (x & 63)) & 0xFF;
+
+		__m128i lo = LookUp4_SSE2(indexed + x    , palette);
+		__m128i hi = LookUp4_SSE2(indexed + x + 4, palette);
+
+		if (smearBits)
 		{
-			*(rgba++) = gGamePalette[*(indexed++)];
+			lo = BlendDitherPairs_SSE2(lo, LookUp4_SSE2(indexed + x + 1, palette), smearBits);
+			hi = BlendDitherPairs_SSE2(hi, LookUp4_SSE2(indexed + x + 5, palette), smearBits >> 4);
 		}
+
+		_mm_storeu_si128((__m128i*) (rgba + x    ), lo);
+		_mm_storeu_si128((__m128i*) (rgba + x + 4), hi);
+	}
+
+	ExpandDitheredTail(rgba, indexed, x, width, palette, smear);
+}
+
+TARGET_AVX2
+static void FindDitherPairs_AVX2(const uint8_t* row, int width, uint64_t* middles, uint64_t* changes)
+{
+	// First 32 pixels the slow way because pixel 0 has no left neighbor
+	int x = 32;
+	MarkDitherPairs(row, 1, std::min(x, width-1), middles, changes);
+
+	// 32 pixels at a time, as long as the last one has a right neighbor
+	for (; x + 33 <= width; x += 32)
+	{
+		__m256i prev	= _mm256_loadu_si256((const __m256i*) (row + x - 1));
+		__m256i me		= _mm256_loadu_si256((const __m256i*) (row + x    ));
+		__m256i next	= _mm256_loadu_si256((const __m256i*) (row + x + 1));
+
+		uint64_t meIsNext	= (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(me, next));
+		uint64_t prevIsNext	= (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(prev, next));
+		uint64_t change		= ~meIsNext & 0xFFFFFFFF;
+
+		changes[x >> 6] |= change << (x & 63);
+		middles[x >> 6] |= (change & prevIsNext) << (x & 63);
 	}
+
+	MarkDitherPairs(row, x, width-1, middles, changes);
 }
 
-static void ConvertIndexedFramebufferToRGBA_FilterDithering(int threadNum, int firstRow, int numRows)
+TARGET_AVX2
+static void ExpandDithered_AVX2(uint32_t* rgba, const uint8_t* indexed, int width, const uint32_t* palette, const uint64_t* smear)
 {
-	uint32_t* rgba				= ((uint32_t*)gRGBAFramebuffer) + firstRow * VISIBLE_WIDTH;
-	const uint8_t* indexed		= gIndexedFramebuffer + firstRow * VISIBLE_WIDTH;
-	uint8_t* smearFlags			= gRowDitherStrides + threadNum * VISIBLE_WIDTH;
+	const __m256i weights	= _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	const __m256i alpha		= _mm256_set1_epi32(0xFF);
+	const __m256i one		= _mm256_set1_epi8(1);
 
-	for (int y = 0; y < numRows; y++)
+	int x = 0;
+
+	// 8 pixels at a time, as long as the last one has a right neighbor
+	for (; x + 8 < width; x += 8)
 	{
-		FilterDithering_Row(indexed, smearFlags);
+		uint32_t smearBits = (smear[x >> 6] >> (x & 63)) & 0xFF;
+
+		__m256i me = _mm256_i32gather_epi32((const int*) palette,
+				_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (indexed + x))), 4);
 
-		for (int x = 0; x < VISIBLE_WIDTH-1; x++)
+		if (smearBits)
 		{
-			if (smearFlags[x])
-			{
-				uint8_t* me		= (uint8_t*) &gGamePalette[*indexed];
-				uint8_t* next	= (uint8_t*) &gGamePalette[*(indexed+1)];
-				uint8_t* out	= (uint8_t*) rgba;
-				out[1] = (me[1] + next[1]) >> 1;
-				out[2] = (me[2] + next[2]) >> 1;
-				out[3] = (me[3] + next[3]) >> 1;
-				smearFlags[x] = 0;			// clear for next row
-			}
-			else
-				*rgba = gGamePalette[*indexed];
+			__m256i next = _mm256_i32gather_epi32((const int*) palette,
+					_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (indexed + x + 1))), 4);
+
+			__m256i mask = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int) smearBits), weights), weights);
+			mask = _mm256_andnot_si256(alpha, mask);
+
+			__m256i avg = _mm256_sub_epi8(_mm256_avg_epu8(me, next), _mm256_and_si256(_mm256_xor_si256(me, next), one));
+
+			me = _mm256_blendv_epi8(me, avg, mask);
+		}
+
+		_mm256_storeu_si256((__m256i*) (rgba + x), me);
+	}
+
+	ExpandDitheredTail(rgba, indexed, x, width, palette, smear);
+}
+#endif
+
+#if FILTER_NEON
+static inline uint64_t MoveMask_NEON(uint8x16_t v)
+{
+	static const uint8_t kBitWeights[16] = { 1,2,4,8,16,32,64,128, 1,2,4,8,16,32,64,128 };
+	uint8x16_t bits = vandq_u8(v, vld1q_u8(kBitWeights));
+	return (uint64_t) vaddv_u8(vget_low_u8(bits)) | ((uint64_t) vaddv_u8(vget_high_u8(bits)) << 8);
+}
+
+static void FindDitherPairs_NEON(const uint8_t* row, int width, uint64_t* middles, uint64_t* changes)
+{
+	// First 16 pixels the slow way because pixel 0 has no left neighbor
+	int x = 16;
+	MarkDitherPairs(row, 1, std::min(x, width-1), middles, changes);
+
+	// 16 pixels at a time, as long as the last one has a right neighbor
+	for (; x + 17 <= width; x += 16)
+	{
+		uint8x16_t prev	= vld1q_u8(row + x - 1);
+		uint8x16_t me	= vld1q_u8(row + x    );
+		uint8x16_t next	= vld1q_u8(row + x + 1);
+
+		uint64_t change		= MoveMask_NEON(vmvnq_u8(vceqq_u8(me, next)));
+		uint64_t prevIsNext	= MoveMask_NEON(vceqq_u8(prev, next));
+
+		changes[x >> 6] |= change << (x & 63);
+		middles[x >> 6] |= (change & prevIsNext) << (x & 63);
+	}
+
+	MarkDitherPairs(row, x, width-1, middles, changes);
+}
+
+static inline uint32x4_t LookUp4_NEON(const uint8_t* indexed, const uint32_t* palette)
+{
+	uint32_t four[4] = { palette[indexed[0]], palette[indexed[1]], palette[indexed[2]], palette[indexed[3]] };
+	return vld1q_u32(four);
+}
+
+static inline uint32x4_t BlendDitherPairs_NEON(uint32x4_t me, uint32x4_t next, uint32_t smearBits)
+{
+	// Expand 4 smear bits to 4 pixel masks, leaving out the alpha byte
+	static const uint32_t kWeights[4] = { 1, 2, 4, 8 };
+	uint32x4_t mask = vtstq_u32(vdupq_n_u32(smearBits), vld1q_u32(kWeights));
+	mask = vbicq_u32(mask, vdupq_n_u32(0xFF));
+
+	// vhaddq_u8 truncates, just like BlendDitherPair
+	uint32x4_t avg = vreinterpretq_u32_u8(vhaddq_u8(vreinterpretq_u8_u32(me), vreinterpretq_u8_u32(next)));
+
+	return vbslq_u32(mask, avg, me);
+}
 
-			rgba++;
-			indexed++;
+static void ExpandDithered_NEON(uint32_t* rgba, const uint8_t* indexed, int width, const uint32_t* palette, const uint64_t* smear)
+{
+	int x = 0;
+
+	// 8 pixels at a time, as long as the last one has a right neighbor
+	for (; x + 8 < width; x += 8)
+	{
+		uint32_t smearBits = (smear[x >> 6] >> (x & 63)) & 0xFF;
+
+		uint32x4_t lo = LookUp4_NEON(indexed + x    , palette);
+		uint32x4_t hi = LookUp4_NEON(indexed + x + 4, palette);
+
+		if (smearBits)
+		{
+			lo = BlendDitherPairs_NEON(lo, LookUp4_NEON(indexed + x + 1, palette), smearBits);
+			hi = BlendDitherPairs_NEON(hi, LookUp4_NEON(indexed + x + 5, palette), smearBits >> 4);
 		}
 
-		*rgba = gGamePalette[*indexed];		// last
-		rgba++;
-		indexed++;
+		vst1q_u32(rgba + x    , lo);
+		vst1q_u32(rgba + x + 4, hi);
 	}
+
+	ExpandDitheredTail(rgba, indexed, x, width, palette, smear);
+}
+#endif
+
+// In:  middles & changes as found by a FindDitherPairs kernel.
+// Out: 'changes' is overwritten with the pixels to smear. 'middles' is trashed.
+// Both arrays must have a zero word right before [0] and right after [numWords-1].
+static void BuildSmearBits(uint64_t* middles, uint64_t* changes, int numWords)
+{
+#define FROM_LEFT(m, i)		(((m)[i] << 1) | ((m)[(i)-1] >> 63))		// bit x = m[x-1]
+#define FROM_RIGHT(m, i)	(((m)[i] >> 1) | ((m)[(i)+1] << 63))		// bit x = m[x+1]
+
+	// Strides: middles, plus single-pixel color changes bridging two middles
+	uint64_t* strides = changes;
+	for (int i = 0; i < numWords; i++)
+		strides[i] = middles[i] | (FROM_LEFT(middles, i) & FROM_RIGHT(middles, i) & changes[i]);
+
+	// Drop strides that are just one middle
+	uint64_t* longStrides = middles;
+	for (int i = 0; i < numWords; i++)
+		longStrides[i] = strides[i] & (FROM_LEFT(strides, i) | FROM_RIGHT(strides, i));
+
+	// Bleed into the left and right dither pixels
+	uint64_t* smear = changes;
+	for (int i = 0; i < numWords; i++)
+		smear[i] = longStrides[i] | FROM_LEFT(longStrides, i) | FROM_RIGHT(longStrides, i);
+
+#undef FROM_LEFT
+#undef FROM_RIGHT
+}
+
+// 'scratchBits' must hold 2 * (GetDitherBitsWordCount(VISIBLE_WIDTH) + 2) words
+static void ConvertRow_FilterDithering(uint32_t* rgba, const uint8_t* indexed, const uint32_t* palette, uint64_t* scratchBits)
+{
+	int numWords = GetDitherBitsWordCount(VISIBLE_WIDTH);
+	uint64_t* middles = scratchBits + 1;
+	uint64_t* changes = scratchBits + numWords + 3;
+
+	memset(scratchBits, 0, 2 * (numWords + 2) * sizeof(uint64_t));		// also zeroes the padding words
+
+	gFindDitherPairs(indexed, VISIBLE_WIDTH, middles, changes);
+	BuildSmearBits(middles, changes, numWords);
+
+	// Blending reads the palette rather than the row so that it always uses unsmeared neighbors,
+	// and every pixel is written exactly once so 'rgba' may point to write-only memory.
+	gExpandDithered(rgba, indexed, VISIBLE_WIDTH, palette, changes);
 }
 
-static inline void FilterDithering_Row(const uint8_t* indexedRow, uint8_t* rowSmearFlags)
+#if _DEBUG
+static void FilterDithering_Row(const uint8_t* indexedRow, uint8_t* rowSmearFlags)
 {
 	static const int THRESH = 2;
 	static const int BLEED = 1;
@@ -131,170 +547,1078 @@ static inline void FilterDithering_Row(const uint8_t* indexedRow, uint8_t* rowSm
 #undef COMMIT_STRIDE
 }
 
-static void DoublePixels(int firstRow, int numRows)
+static void ConvertRow_FilterDithering_Reference(uint32_t* rgba, const uint8_t* indexed, const uint32_t* palette)
 {
-	const uint32_t* rgba		= ((uint32_t*)gRGBAFramebuffer) + firstRow * VISIBLE_WIDTH;
-	uint32_t* rgbaX2			= ((uint32_t*)gRGBAFramebufferX2) + firstRow * VISIBLE_WIDTH * 2 * 2;
+	std::vector<uint8_t> smearFlags(VISIBLE_WIDTH, 0);
+	FilterDithering_Row(indexed, smearFlags.data());
 
-	for (int y = 0; y < numRows; y++)
+	for (int x = 0; x < VISIBLE_WIDTH; x++)
 	{
-		uint32_t* x2RowStart = rgbaX2;
+		if (x < VISIBLE_WIDTH-1 && smearFlags[x])
+			rgba[x] = BlendDitherPair(palette[indexed[x]], palette[indexed[x+1]]);
+		else
+			rgba[x] = palette[indexed[x]];
+	}
+}
 
-		for (int x = 0; x < VISIBLE_WIDTH; x++)
+static void VerifyDitheredRow(const uint8_t* indexed, const uint32_t* palette)
+{
+	std::vector<uint32_t> expected(VISIBLE_WIDTH);
+	std::vector<uint32_t> actual(VISIBLE_WIDTH);
+	std::vector<uint64_t> scratchBits(2 * (GetDitherBitsWordCount(VISIBLE_WIDTH) + 2));
+
+	ConvertRow_FilterDithering_Reference(expected.data(), indexed, palette);
+	ConvertRow_FilterDithering(actual.data(), indexed, palette, scratchBits.data());
+	GAME_ASSERT_MESSAGE(expected == actual, "Dithering kernel doesn't match reference");
+}
+
+static void VerifyDitherKernels(void)
+{
+	std::vector<uint8_t> row(VISIBLE_WIDTH);
+	uint32_t palette[256];
+
+	uint32_t seed = 0x4D696B65;
+	for (int i = 0; i < 256; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		palette[i] = seed;
+	}
+
+	// Random runs of dither patterns, solid colors and noise, drawn from few colors
+	// so that the state machine's corner cases come up often
+	for (int trial = 0; trial < 256; trial++)
+	{
+		for (int x = 0; x < VISIBLE_WIDTH; )
 		{
-			uint32_t pixel = *(rgba++);
-			*(rgbaX2++) = pixel;
-			*(rgbaX2++) = pixel;
+			seed = seed * 1664525 + 1013904223;
+			int runLength	= 1 + (seed >> 27);
+			int kind		= (seed >> 8) % 3;
+			uint8_t a		= (seed >> 12) & 3;
+			uint8_t b		= (seed >> 16) & 3;
+
+			for (int i = 0; i < runLength && x < VISIBLE_WIDTH; i++, x++)
+			{
+				seed = seed * 1664525 + 1013904223;
+
+				switch (kind)
+				{
+					case 0:		row[x] = (x & 1) ? a : b;		break;
+					case 1:		row[x] = a;						break;
+					default:	row[x] = (seed >> 24) & 3;		break;
+				}
+			}
 		}
 
-		memcpy(rgbaX2, x2RowStart, sizeof(uint32_t) * VISIBLE_WIDTH * 2);
-		rgbaX2 += VISIBLE_WIDTH * 2;
+		VerifyDitheredRow(row.data(), palette);
 	}
 }
+#endif
 
 // ----------------------------------------------------------------------------
+// Pixel-pair lookup table.
+// Maps two adjacent indexed pixels, read as one uint16, to both of their RGBA colors,
+// so converting a row takes half as many lookups.
+// The table has 65536 entries. It is patched only for the colors that changed
+// since it was last built, and only once the palette has stopped changing:
+// during fades the palette changes on every present, and plain palette lookups
+// beat rebuilding the table every frame.
+// It beats the SSE2 and scalar palette kernels but not the AVX2 gathers, so it is only
+// used for unfiltered rows on CPUs without AVX2. The dithering kernels all beat it.
 
-static void RaiseLatches()
-{
-	gLatchMask = (1ul << gRenderThreadPool.size()) - 1ul;
-}
+static constexpr int kPairLUTMaxPatchedColors = 64;	// more changed colors than this: rebuild the whole table
+static constexpr int kPairLUTSettlePresents = 2;	// palette must be unchanged for this many presents before the table is used
 
-static bool IsLatchRaised(int threadNum)
+static std::vector<uint64_t>	gPairLUT;
+static GamePalette				gPairLUTPalette;			// colors currently in the table
+static bool						gPairLUTValid = false;
+static bool						gPairLUTWanted = false;		// set by SelectFilterKernels
+static bool						gPairLUTActive = false;		// used by the conversion in flight
+static GamePalette				gPreviousPalette;			// palette of the previous conversion
+static int						gPresentsSincePaletteChange = 0;
+static int						gPairLUTLastPatchedColors = 0;
+static double					gPairLUTLastPatchMs = 0;	// last rebuild cost, for the debug title bar
+static char						gPairLUTStatus[32] = "lut off";
+
+static inline uint16_t PairKey(uint8_t left, uint8_t right)
 {
-	return (gLatchMask >> threadNum) & 1;
+	uint8_t pair[2] = { left, right };
+	uint16_t key;
+	memcpy(&key, pair, sizeof(key));			// same byte order as when loading a pair from the framebuffer
+	return key;
 }
 
-static void LowerLatch(int threadNum)
+static inline uint64_t PairColors(uint32_t left, uint32_t right)
 {
-	gLatchMask &= ~(1 << threadNum);
+	uint32_t pair[2] = { left, right };
+	uint64_t colors;
+	memcpy(&colors, pair, sizeof(colors));		// same byte order as when storing a pair to the RGBA row
+	return colors;
 }
 
-static void TellMainThreadImReady(int threadNum)
+static void ExpandPalette_PairLUT(uint32_t* rgba, const uint8_t* indexed, int count)
 {
-	LowerLatch(threadNum);
+	const uint64_t* lut = gPairLUT.data();
+	int x = 0;
+
+	for (; x + 2 <= count; x += 2)
+	{
+		uint16_t key;
+		memcpy(&key, indexed + x, sizeof(key));
+		memcpy(rgba + x, &lut[key], sizeof(uint64_t));
+	}
 
-	if (gLatchMask == 0)
+	if (x < count)
 	{
-		gRenderersToMain.notify_one();
+		rgba[x] = gPairLUTPalette[indexed[x]];
 	}
 }
 
-static void ConverterThread(int threadNo, int firstRow, int numRows)
+static void UpdatePixelPairLUT(const uint32_t* palette, bool filterDithering)
 {
-#if !_WIN32 && _GNU_SOURCE
-	char name[32];
-	snprintf(name, sizeof(name), "Rows %03d-%03d", firstRow, firstRow+numRows-1);
-	pthread_setname_np(pthread_self(), name);
-#endif
+	gPairLUTActive = false;
+
+	if (0 != memcmp(gPreviousPalette, palette, sizeof(GamePalette)))
+	{
+		memcpy(gPreviousPalette, palette, sizeof(GamePalette));
+		gPresentsSincePaletteChange = 0;
+	}
+	else if (gPresentsSincePaletteChange < kPairLUTSettlePresents)
+	{
+		gPresentsSincePaletteChange++;
+	}
 
-	// Initial condition: tell main thread we're ready
+	if (!gPairLUTWanted || filterDithering)
 	{
-		std::scoped_lock lock(gMutex);
-		TellMainThreadImReady(threadNo);
+		snprintf(gPairLUTStatus, sizeof(gPairLUTStatus), "lut off");
+		return;
 	}
 
-	while (true)
+	if (gPresentsSincePaletteChange < kPairLUTSettlePresents)		// palette still changing (fade?)
 	{
-		// Wait on main to raise latch
-		{
-			std::unique_lock lock(gMutex);
+		snprintf(gPairLUTStatus, sizeof(gPairLUTStatus), "lut wait");
+		return;
+	}
 
-			gMainToRenderers.wait(lock, [=] { return IsLatchRaised(threadNo); });
+	gPairLUTActive = true;
+	snprintf(gPairLUTStatus, sizeof(gPairLUTStatus), "lut %d:%.2fms", gPairLUTLastPatchedColors, gPairLUTLastPatchMs);
 
-			if (gQuitRenderThreads)
-				break;
+			/* FIND COLORS THAT CHANGED SINCE THE TABLE WAS BUILT */
+
+	int changed[256];
+	int numChanged = 0;
+
+	if (!gPairLUTValid)
+	{
+		numChanged = 256;
+	}
+	else
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			if (gPairLUTPalette[i] != palette[i])
+				changed[numChanged++] = i;
 		}
+	}
 
-		// Do the work
-		if (gGamePrefs.filterDithering)
-			ConvertIndexedFramebufferToRGBA_FilterDithering(threadNo, firstRow, numRows);
-		else
-			ConvertIndexedFramebufferToRGBA_NoFilter(firstRow, numRows);
+	if (numChanged == 0)
+	{
+		return;
+	}
+
+			/* PATCH OR REBUILD */
 
-		if (gGamePrefs.scalingType == kScaling_HQStretch)
-			DoublePixels(firstRow, numRows);
+	uint64_t startTime = SDL_GetPerformanceCounter();
 
-		// Tell main thread we're ready (lower latch)
+	memcpy(gPairLUTPalette, palette, sizeof(GamePalette));
+	gPairLUT.resize(256 * 256);
+
+	if (numChanged > kPairLUTMaxPatchedColors)
+	{
+		for (int left = 0; left < 256; left++)
+		for (int right = 0; right < 256; right++)
+			gPairLUT[PairKey(left, right)] = PairColors(palette[left], palette[right]);
+	}
+	else
+	{
+		// Only the pairs where either pixel uses a changed color
+		for (int i = 0; i < numChanged; i++)
 		{
-			std::scoped_lock lock(gMutex);
-			TellMainThreadImReady(threadNo);
+			int c = changed[i];
+			for (int other = 0; other < 256; other++)
+			{
+				gPairLUT[PairKey(c, other)] = PairColors(palette[c], palette[other]);
+				gPairLUT[PairKey(other, c)] = PairColors(palette[other], palette[c]);
+			}
 		}
 	}
+
+	gPairLUTValid = true;
+
+	gPairLUTLastPatchedColors = numChanged;
+	gPairLUTLastPatchMs = (SDL_GetPerformanceCounter() - startTime) * 1000.0 / SDL_GetPerformanceFrequency();
+	snprintf(gPairLUTStatus, sizeof(gPairLUTStatus), "lut %d:%.2fms", gPairLUTLastPatchedColors, gPairLUTLastPatchMs);
 }
 
+const char* GetPixelPairLUTStatus(void)
+{
+	return gPairLUTStatus;
+}
+
+// ----------------------------------------------------------------------------
+// Edge-aware upscalers: Scale2x and Scale3x (EPX family).
+// Every source pixel E becomes a 2x2 or 3x3 block of E, except that corners
+// where two same-colored neighbors meet at a diagonal take on their color.
+// This keeps sprite outlines sharp without inventing new colors.
+//
+// Neighbors:	A B C
+//				D E F
+//				G H I
+//
+// Pixels beyond the edges of the frame repeat the edge pixel.
+// The SIMD kernels do the interior pixels and leave the edges to the scalar span.
+
+typedef void (*ScaleRowKernel)(uint32_t** out, const uint32_t* above, const uint32_t* row, const uint32_t* below, int width);
+
+static ScaleRowKernel	gScale2xRow = nullptr;
+static ScaleRowKernel	gScale3xRow = nullptr;
 
-static void WaitForAllRenderThreadsReady()
+static inline bool IsEdgeAwareScaling(int scalingType)
 {
-	std::unique_lock lock(gMutex);
-	gRenderersToMain.wait(lock, [] { return gLatchMask == 0; });
-	lock.unlock();
+	return scalingType == kScaling_Scale2x || scalingType == kScaling_Scale3x;
 }
 
-static void InitRenderThreadPool()
+static void Scale2xSpan(uint32_t** out, const uint32_t* above, const uint32_t* row, const uint32_t* below, int begin, int end, int width)
 {
-	gQuitRenderThreads = false;
-	RaiseLatches();
+	for (int x = begin; x < end; x++)
+	{
+		uint32_t B = above[x];
+		uint32_t D = row[x > 0 ? x-1 : x];
+		uint32_t E = row[x];
+		uint32_t F = row[x < width-1 ? x+1 : x];
+		uint32_t H = below[x];
 
-	int rowsPerThread = VISIBLE_HEIGHT / gNumThreads;
-	int remainder = VISIBLE_HEIGHT - rowsPerThread * gNumThreads;
-	int y = 0;
+		uint32_t E0 = E, E1 = E, E2 = E, E3 = E;
 
-	for (int i = 0; i < gNumThreads; i++)
-	{
-		// Distribute number of rows as evenly as possible
-		int rowsThisThread = rowsPerThread;
-		if (remainder > 0)
+		if (B != H && D != F)
 		{
-			rowsThisThread++;
-			remainder--;
+			if (D == B) E0 = D;
+			if (B == F) E1 = F;
+			if (D == H) E2 = D;
+			if (H == F) E3 = F;
 		}
 
-		// Create thread
-		gRenderThreadPool.emplace_back(ConverterThread, i, y, rowsThisThread);
-
-		y += rowsThisThread;
+		out[0][2*x+0] = E0;
+		out[0][2*x+1] = E1;
+		out[1][2*x+0] = E2;
+		out[1][2*x+1] = E3;
 	}
-
-	// Wait for all threads to be ready so they don't miss the condition when we start rendering
-	WaitForAllRenderThreadsReady();
 }
 
-void ConvertFramebufferToRGBA(void)
+static void Scale3xSpan(uint32_t** out, const uint32_t* above, const uint32_t* row, const uint32_t* below, int begin, int end, int width)
 {
-	if (gRenderThreadPool.empty())
+	for (int x = begin; x < end; x++)
 	{
-		InitRenderThreadPool();
-	}
+		int left	= x > 0 ? x-1 : x;
+		int right	= x < width-1 ? x+1 : x;
 
-	{
-		std::scoped_lock lock(gMutex);
-		RaiseLatches();
-		gMainToRenderers.notify_all();
+		uint32_t A = above[left],	B = above[x],	C = above[right];
+		uint32_t D = row[left],		E = row[x],		F = row[right];
+		uint32_t G = below[left],	H = below[x],	I = below[right];
+
+		uint32_t E0 = E, E1 = E, E2 = E, E3 = E, E5 = E, E6 = E, E7 = E, E8 = E;
+
+		if (B != H && D != F)
+		{
+			if (D == B)								E0 = D;
+			if ((D == B && E != C) || (B == F && E != A))	E1 = B;
+			if (B == F)								E2 = F;
+			if ((D == B && E != G) || (D == H && E != A))	E3 = D;
+			if ((B == F && E != I) || (H == F && E != C))	E5 = F;
+			if (D == H)								E6 = D;
+			if ((D == H && E != I) || (H == F && E != G))	E7 = H;
+			if (H == F)								E8 = F;
+		}
+
+		out[0][3*x+0] = E0;		out[0][3*x+1] = E1;		out[0][3*x+2] = E2;
+		out[1][3*x+0] = E3;		out[1][3*x+1] = E;		out[1][3*x+2] = E5;
+		out[2][3*x+0] = E6;		out[2][3*x+1] = E7;		out[2][3*x+2] = E8;
 	}
+}
 
-	WaitForAllRenderThreadsReady();
+static void Scale2xRow_Scalar(uint32_t** out, const uint32_t* above, const uint32_t* row, const uint32_t* below, int width)
+{
+	Scale2xSpan(out, above, row, below, 0, width, width);
 }
 
-void ShutdownRenderThreads(void)
+static void Scale3xRow_Scalar(uint32_t** out, const uint32_t* above, const uint32_t* row, const uint32_t* below, int width)
 {
-	if (gRenderThreadPool.empty())
-	{
-		return;
-	}
+	Scale3xSpan(out, above, row, below, 0, width, width);
+}
 
-	// Tell all threads they need to quit
-	{
-		std::scoped_lock lock(gMutex);
-		gQuitRenderThreads = true;
-		RaiseLatches();
-		gMainToRenderers.notify_all();
-	}
+#if FILTER_X86
+TARGET_SSE2
+static inline __m128i Select_SSE2(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Stores a0 b0 c0 a1 b1 c1 a2 b2 c2 a3 b3 c3
+TARGET_SSE2
+static inline void StoreInterleaved3_SSE2(uint32_t* out, __m128i a, __m128i b, __m128i c)
+{
+	__m128 ab_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(a, b));		// a0 b0 a1 b1
+	__m128 ab_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(a, b));		// a2 b2 a3 b3
+	__m128 ca_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(c, a));		// c0 a0 c1 a1
+	__m128 ca_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(c, a));		// c2 a2 c3 a3
+	__m128 bc_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(b, c));		// b0 c0 b1 c1
+	__m128 bc_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(b, c));		// b2 c2 b3 c3
+
+	_mm_storeu_ps((float*) (out + 0), _mm_shuffle_ps(ab_lo, ca_lo, _MM_SHUFFLE(3,0,1,0)));
+	_mm_storeu_ps((float*) (out + 4), _mm_shuffle_ps(bc_lo, ab_hi, _MM_SHUFFLE(1,0,3,2)));
+	_mm_storeu_ps((float*) (out + 8), _mm_shuffle_ps(ca_hi, bc_hi, _MM_SHUFFLE(3,2,3,0)));
+}
+
+TARGET_SSE2
+static void Scale2xRow_SSE2(uint32_t** out, const uint32_t* above, const uint32_t* row, const uint32_t* below, int width)
+{
+	Scale2xSpan(out, above, row, below, 0, 1, width);
+
+	int x = 1;
 
-	// Wait on all threads
-	for (auto& t : gRenderThreadPool)
+	// 4 pixels at a time, as long as the last one has a right neighbor
+	for (; x + 4 < width; x += 4)
 	{
-		t.join();
-	}
+		__m128i B = _mm_loadu_si128((const __m128i*) (above + x    ));
+		__m128i D = _mm_loadu_si128((const __m128i*) (row   + x - 1));
+		__m128i E = _mm_loadu_si128((const __m128i*) (row   + x    ));
+		__m128i F = _mm_loadu_si128((const __m128i*) (row   + x + 1));
+		__m128i H = _mm_loadu_si128((const __m128i*) (below + x    ));
+
+		__m128i E0 = E, E1 = E, E2 = E, E3 = E;
 
-	gRenderThreadPool.clear();
-}
\ No newline at end of file
+		__m128i flat = _mm_or_si128(_mm_cmpeq_epi32(B, H), _mm_cmpeq_epi32(D, F));
+
+		if (_mm_movemask_epi8(flat) != 0xFFFF)		// skip blends in flat areas
+		{
+			E0 = Select_SSE2(_mm_andnot_si128(flat, _mm_cmpeq_epi32(D, B)), D, E);
+			E1 = Select_SSE2(_mm_andnot_si128(flat, _mm_cmpeq_epi32(B, F)), F, E);
+			E2 = Select_SSE2(_mm_andnot_si128(flat, _mm_cmpeq_epi32(D, H)), D, E);
+			E3 = Select_SSE2(_mm_andnot_si128(flat, _mm_cmpeq_epi32(H, F)), F, E);
+		}
+
+		_mm_storeu_si128((__m128i*) (out[0] + 2*x    ), _mm_unpacklo_epi32(E0, E1));
+		_mm_storeu_si128((__m128i*) (out[0] + 2*x + 4), _mm_unpackhi_epi32(E0, E1));
+		_mm_storeu_si128((__m128i*) (out[1] + 2*x    ), _mm_unpacklo_epi32(E2, E3));
+		_mm_storeu_si128((__m128i*) (out[1] + 2*x + 4), _mm_unpackhi_epi32(E2, E3));
+	}
+
+	Scale2xSpan(out, above, row, below, x, width, width);
+}
+
+TARGET_SSE2
+static void Scale3xRow_SSE2(uint32_t** out, const uint32_t* above, const uint32_t* row, const uint32_t* below, int width)
+{
+	Scale3xSpan(out, above, row, below, 0, 1, width);
+
+	int x = 1;
+
+	// 4 pixels at a time, as long as the last one has a right neighbor
+	for (; x + 4 < width; x += 4)
+	{
+		__m128i A = _mm_loadu_si128((const __m128i*) (above + x - 1));
+		__m128i B = _mm_loadu_si128((const __m128i*) (above + x    ));
+		__m128i C = _mm_loadu_si128((const __m128i*) (above + x + 1));
+		__m128i D = _mm_loadu_si128((const __m128i*) (row   + x - 1));
+		__m128i E = _mm_loadu_si128((const __m128i*) (row   + x    ));
+		__m128i F = _mm_loadu_si128((const __m128i*) (row   + x + 1));
+		__m128i G = _mm_loadu_si128((const __m128i*) (below + x - 1));
+		__m128i H = _mm_loadu_si128((const __m128i*) (below + x    ));
+		__m128i I = _mm_loadu_si128((const __m128i*) (below + x + 1));
+
+		__m128i E0 = E, E1 = E, E2 = E, E3 = E, E5 = E, E6 = E, E7 = E, E8 = E;
+
+		__m128i flat = _mm_or_si128(_mm_cmpeq_epi32(B, H), _mm_cmpeq_epi32(D, F));
+
+		if (_mm_movemask_epi8(flat) != 0xFFFF)		// skip blends in flat areas
+		{
+			__m128i DB = _mm_andnot_si128(flat, _mm_cmpeq_epi32(D, B));
+			__m128i BF = _mm_andnot_si128(flat, _mm_cmpeq_epi32(B, F));
+			__m128i DH = _mm_andnot_si128(flat, _mm_cmpeq_epi32(D, H));
+			__m128i HF = _mm_andnot_si128(flat, _mm_cmpeq_epi32(H, F));
+			__m128i EA = _mm_cmpeq_epi32(E, A);
+			__m128i EC = _mm_cmpeq_epi32(E, C);
+			__m128i EG = _mm_cmpeq_epi32(E, G);
+			__m128i EI = _mm_cmpeq_epi32(E, I);
+
+			E0 = Select_SSE2(DB, D, E);
+			E1 = Select_SSE2(_mm_or_si128(_mm_andnot_si128(EC, DB), _mm_andnot_si128(EA, BF)), B, E);
+			E2 = Select_SSE2(BF, F, E);
+			E3 = Select_SSE2(_mm_or_si128(_mm_andnot_si128(EG, DB), _mm_andnot_si128(EA, DH)), D, E);
+			E5 = Select_SSE2(_mm_or_si128(_mm_andnot_si128(EI, BF), _mm_andnot_si128(EC, HF)), F, E);
+			E6 = Select_SSE2(DH, D, E);
+			E7 = Select_SSE2(_mm_or_si128(_mm_andnot_si128(EI, DH), _mm_andnot_si128(EG, HF)), H, E);
+			E8 = Select_SSE2(HF, F, E);
+		}
+
+		StoreInterleaved3_SSE2(out[0] + 3*x, E0, E1, E2);
+		StoreInterleaved3_SSE2(out[1] + 3*x, E3, E, E5);
+		StoreInterleaved3_SSE2(out[2] + 3*x, E6, E7, E8);
+	}
+
+	Scale3xSpan(out, above, row, below, x, width, width);
+}
+#endif
+
+#if FILTER_NEON
+static void Scale2xRow_NEON(uint32_t** out, const uint32_t* above, const uint32_t* row, const uint32_t* below, int width)
+{
+	Scale2xSpan(out, above, row, below, 0, 1, width);
+
+	int x = 1;
+
+	// 4 pixels at a time, as long as the last one has a right neighbor
+	for (; x + 4 < width; x += 4)
+	{
+		uint32x4_t B = vld1q_u32(above + x    );
+		uint32x4_t D = vld1q_u32(row   + x - 1);
+		uint32x4_t E = vld1q_u32(row   + x    );
+		uint32x4_t F = vld1q_u32(row   + x + 1);
+		uint32x4_t H = vld1q_u32(below + x    );
+
+		uint32x4x2_t top = {{ E, E }};
+		uint32x4x2_t bottom = {{ E, E }};
+
+		uint32x4_t edge = vmvnq_u32(vorrq_u32(vceqq_u32(B, H), vceqq_u32(D, F)));
+
+		if (vmaxvq_u32(edge))					// skip blends in flat areas
+		{
+			top.val[0]		= vbslq_u32(vandq_u32(edge, vceqq_u32(D, B)), D, E);
+			top.val[1]		= vbslq_u32(vandq_u32(edge, vceqq_u32(B, F)), F, E);
+			bottom.val[0]	= vbslq_u32(vandq_u32(edge, vceqq_u32(D, H)), D, E);
+			bottom.val[1]	= vbslq_u32(vandq_u32(edge, vceqq_u32(H, F)), F, E);
+		}
+
+		vst2q_u32(out[0] + 2*x, top);
+		vst2q_u32(out[1] + 2*x, bottom);
+	}
+
+	Scale2xSpan(out, above, row, below, x, width, width);
+}
+
+static void Scale3xRow_NEON(uint32_t** out, const uint32_t* above, const uint32_t* row, const uint32_t* below, int width)
+{
+	Scale3xSpan(out, above, row, below, 0, 1, width);
+
+	int x = 1;
+
+	// 4 pixels at a time, as long as the last one has a right neighbor
+	for (; x + 4 < width; x += 4)
+	{
+		uint32x4_t A = vld1q_u32(above + x - 1);
+		uint32x4_t B = vld1q_u32(above + x    );
+		uint32x4_t C = vld1q_u32(above + x + 1);
+		uint32x4_t D = vld1q_u32(row   + x - 1);
+		uint32x4_t E = vld1q_u32(row   + x    );
+		uint32x4_t F = vld1q_u32(row   + x + 1);
+		uint32x4_t G = vld1q_u32(below + x - 1);
+		uint32x4_t H = vld1q_u32(below + x    );
+		uint32x4_t I = vld1q_u32(below + x + 1);
+
+		uint32x4x3_t top	= {{ E, E, E }};
+		uint32x4x3_t middle	= {{ E, E, E }};
+		uint32x4x3_t bottom	= {{ E, E, E }};
+
+		uint32x4_t edge = vmvnq_u32(vorrq_u32(vceqq_u32(B, H), vceqq_u32(D, F)));
+
+		if (vmaxvq_u32(edge))					// skip blends in flat areas
+		{
+			uint32x4_t DB = vandq_u32(edge, vceqq_u32(D, B));
+			uint32x4_t BF = vandq_u32(edge, vceqq_u32(B, F));
+			uint32x4_t DH = vandq_u32(edge, vceqq_u32(D, H));
+			uint32x4_t HF = vandq_u32(edge, vceqq_u32(H, F));
+			uint32x4_t EA = vceqq_u32(E, A);
+			uint32x4_t EC = vceqq_u32(E, C);
+			uint32x4_t EG = vceqq_u32(E, G);
+			uint32x4_t EI = vceqq_u32(E, I);
+
+			top.val[0]		= vbslq_u32(DB, D, E);
+			top.val[1]		= vbslq_u32(vorrq_u32(vbicq_u32(DB, EC), vbicq_u32(BF, EA)), B, E);
+			top.val[2]		= vbslq_u32(BF, F, E);
+			middle.val[0]	= vbslq_u32(vorrq_u32(vbicq_u32(DB, EG), vbicq_u32(DH, EA)), D, E);
+			middle.val[2]	= vbslq_u32(vorrq_u32(vbicq_u32(BF, EI), vbicq_u32(HF, EC)), F, E);
+			bottom.val[0]	= vbslq_u32(DH, D, E);
+			bottom.val[1]	= vbslq_u32(vorrq_u32(vbicq_u32(DH, EI), vbicq_u32(HF, EG)), H, E);
+			bottom.val[2]	= vbslq_u32(HF, F, E);
+		}
+
+		vst3q_u32(out[0] + 3*x, top);
+		vst3q_u32(out[1] + 3*x, middle);
+		vst3q_u32(out[2] + 3*x, bottom);
+	}
+
+	Scale3xSpan(out, above, row, below, x, width, width);
+}
+#endif
+
+#if _DEBUG
+static void VerifyScaleKernel(ScaleRowKernel kernel, ScaleRowKernel reference)
+{
+	static const int kWidth = 61;				// odd, so the scalar tail gets exercised too
+
+	uint32_t source[3][kWidth];
+	std::vector<uint32_t> expected(3 * 3 * kWidth);
+	std::vector<uint32_t> actual(3 * 3 * kWidth);
+
+	uint32_t seed = 0x4D696B65;
+
+	for (int trial = 0; trial < 256; trial++)
+	{
+		for (int y = 0; y < 3; y++)
+		for (int x = 0; x < kWidth; x++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			source[y][x] = (seed >> 30) * 0x01020304u;		// few colors, so that matching neighbors are common
+		}
+
+		uint32_t* expectedRows[3]	= { &expected[0], &expected[3*kWidth], &expected[6*kWidth] };
+		uint32_t* actualRows[3]		= { &actual[0], &actual[3*kWidth], &actual[6*kWidth] };
+
+		reference(expectedRows, source[0], source[1], source[2], kWidth);
+		kernel(actualRows, source[0], source[1], source[2], kWidth);
+
+		GAME_ASSERT_MESSAGE(expected == actual, "Scaler kernel doesn't match reference");
+	}
+}
+#endif
+
+// ----------------------------------------------------------------------------
+
+static void SelectFilterKernels(void)
+{
+	gExpandPalette = ExpandPalette_Scalar;
+	gFindDitherPairs = FindDitherPairs_Scalar;
+	gExpandDithered = ExpandDithered_Scalar;
+	gScale2xRow = Scale2xRow_Scalar;
+	gScale3xRow = Scale3xRow_Scalar;
+	gExpandPaletteKernelName = "scalar";
+	gPairLUTWanted = true;
+
+#if FILTER_X86
+	if (SDL_HasSSE2())
+	{
+		gScale2xRow = Scale2xRow_SSE2;
+		gScale3xRow = Scale3xRow_SSE2;
+	}
+#elif FILTER_NEON
+	if (SDL_HasNEON())
+	{
+		gScale2xRow = Scale2xRow_NEON;
+		gScale3xRow = Scale3xRow_NEON;
+	}
+#endif
+
+#if FILTER_X86
+	if (SDL_HasAVX2())
+	{
+		gExpandPalette = ExpandPalette_AVX2;
+		gFindDitherPairs = FindDitherPairs_AVX2;
+		gExpandDithered = ExpandDithered_AVX2;
+		gExpandPaletteKernelName = "avx2";
+		gPairLUTWanted = false;				// the gathers beat the pixel-pair table
+	}
+	else if (SDL_HasSSE2())
+	{
+		gExpandPalette = ExpandPalette_SSE2;
+		gFindDitherPairs = FindDitherPairs_SSE2;
+		gExpandDithered = ExpandDithered_SSE2;
+		gExpandPaletteKernelName = "sse2";
+	}
+#elif FILTER_NEON
+	if (SDL_HasNEON())
+	{
+		// No gather on NEON: palette expansion stays on the scalar kernel
+		gFindDitherPairs = FindDitherPairs_NEON;
+		gExpandDithered = ExpandDithered_NEON;
+		gExpandPaletteKernelName = "neon";
+	}
+#endif
+
+#if _DEBUG
+	VerifyPaletteKernel(gExpandPalette, gExpandPaletteKernelName);
+	VerifyDitherKernels();
+	VerifyScaleKernel(gScale2xRow, Scale2xRow_Scalar);
+	VerifyScaleKernel(gScale3xRow, Scale3xRow_Scalar);
+#endif
+}
+
+const char* GetPaletteKernelName(void)
+{
+	return gExpandPaletteKernelName;
+}
+
+// ----------------------------------------------------------------------------
+
+static void DoublePixels(uint32_t* topRow, uint32_t* bottomRow, const uint32_t* rgba)
+{
+	for (int x = 0; x < VISIBLE_WIDTH; x++)
+	{
+		uint32_t pixel = rgba[x];
+		topRow[2*x+0] = pixel;
+		topRow[2*x+1] = pixel;
+		bottomRow[2*x+0] = pixel;
+		bottomRow[2*x+1] = pixel;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static void ConvertRowTo1x(int workerNum, int y, const RGBATarget* target, uint32_t* rgba)
+{
+	const uint8_t* indexed = target->indexed + y * VISIBLE_WIDTH;
+
+	if (target->filterDithering)
+	{
+		int bitsPerWorker = 2 * (GetDitherBitsWordCount(VISIBLE_WIDTH) + 2);
+		ConvertRow_FilterDithering(rgba, indexed, target->palette, gScratchBits.data() + workerNum * bitsPerWorker);
+
+#if _DEBUG
+		// Keep checking the kernels against the reference on real frames, a few rows per present
+		if (y % kDitherVerifyInterval == gDitherVerifyPhase)
+			VerifyDitheredRow(indexed, target->palette);
+#endif
+	}
+	else if (gPairLUTActive)
+	{
+		ExpandPalette_PairLUT(rgba, indexed, VISIBLE_WIDTH);
+	}
+	else
+	{
+		gExpandPalette(rgba, indexed, VISIBLE_WIDTH, target->palette);
+	}
+}
+
+static void ConvertRow(int workerNum, int y, const RGBATarget* target)
+{
+	uint8_t* outRow = target->pixels + (y - target->firstRow) * target->scale * target->pitch;
+
+	// When doubling, build the 1x row in scratch memory first.
+	// This way we never read back from 'pixels', which may be a locked texture.
+	uint32_t* rgba = (target->scale == 1)
+			? (uint32_t*) outRow
+			: gScratchRows.data() + workerNum * kScratchRowsPerWorker * VISIBLE_WIDTH;
+
+	ConvertRowTo1x(workerNum, y, target, rgba);
+
+	if (target->scale == 2)
+		DoublePixels((uint32_t*) outRow, (uint32_t*) (outRow + target->pitch), rgba);
+}
+
+// Single-color rows (e.g. blank interlace lines) don't need the full conversion
+static void FillRow(int y, const RGBATarget* target)
+{
+	uint32_t color = target->palette[target->indexed[y * VISIBLE_WIDTH]];
+	uint8_t* outRow = target->pixels + (y - target->firstRow) * target->scale * target->pitch;
+
+	for (int i = 0; i < target->scale; i++)
+	{
+		std::fill_n((uint32_t*) (outRow + i * target->pitch), VISIBLE_WIDTH * target->scale, color);
+	}
+}
+
+static void ConvertRowChunk(void* userData, int begin, int end, int workerNum)
+{
+	const RGBATarget* target = (const RGBATarget*) userData;
+
+	for (int y = target->firstRow + begin; y < target->firstRow + end; y++)
+	{
+		// Fused playfield: the row is still in the PF buffer. Copy it now, while we're about to read it anyway.
+		if (target->fusedPlayfield && y >= PF_WINDOW_TOP && y < PF_WINDOW_TOP + PF_WINDOW_HEIGHT)
+			CopyPlayfieldRow(target->playfieldLeft, target->playfieldTop, y - PF_WINDOW_TOP);
+
+		if (target->dirtyRows[y] == kDirtyRow_Uniform)
+			FillRow(y, target);
+		else if (target->dirtyRows[y])
+			ConvertRow(workerNum, y, target);
+	}
+}
+
+// The edge-aware scalers need the rows above and below each row they scale,
+// so each worker keeps a rolling window of the last 3 rows it converted.
+static const uint32_t* GetScalerSourceRow(int workerNum, int y, const RGBATarget* target, int* windowRows)
+{
+	y = std::clamp(y, 0, VISIBLE_HEIGHT-1);		// repeat edge rows
+
+	int slot = y % kScalerWindowRows;
+	uint32_t* rgba = gScratchRows.data() + (workerNum * kScratchRowsPerWorker + slot) * VISIBLE_WIDTH;
+
+	if (windowRows[slot] != y)
+	{
+		ConvertRowTo1x(workerNum, y, target, rgba);
+		windowRows[slot] = y;
+	}
+
+	return rgba;
+}
+
+static void ScaleBand(void* userData, int begin, int end, int workerNum)
+{
+	const RGBATarget* target = (const RGBATarget*) userData;
+	ScaleRowKernel scaleRow = (target->scale == 3) ? gScale3xRow : gScale2xRow;
+
+	int windowRows[kScalerWindowRows] = { -1, -1, -1 };
+
+	for (int y = target->firstRow + begin; y < target->firstRow + end; y++)
+	{
+		if (!target->dirtyRows[y])
+			continue;
+
+		const uint32_t* above	= GetScalerSourceRow(workerNum, y-1, target, windowRows);
+		const uint32_t* row		= GetScalerSourceRow(workerNum, y  , target, windowRows);
+		const uint32_t* below	= GetScalerSourceRow(workerNum, y+1, target, windowRows);
+
+		uint8_t* outRow = target->pixels + (y - target->firstRow) * target->scale * target->pitch;
+		uint32_t* out[3] =
+		{
+			(uint32_t*) (outRow),
+			(uint32_t*) (outRow + target->pitch),
+			(uint32_t*) (outRow + target->pitch * 2),
+		};
+
+		scaleRow(out, above, row, below, VISIBLE_WIDTH);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Output-sized scaling (kScaling_OutputInteger/Bilinear).
+// The workers write the final image at the renderer's output size, letterbox bars included,
+// so SDL only has to do a 1:1 copy. This matters on the software renderer,
+// whose generic stretch runs single-threaded.
+
+// Fixed-point sample positions for each output column/row of the content rect:
+// source index in the low 16 bits, weight of the next source pixel (0-256) in the high bits.
+static std::vector<uint32_t> gColumnTaps;
+static std::vector<uint32_t> gRowTaps;
+static OutputMapping gTapsMapping;
+static int gTapsSourceWidth = 0;
+static int gTapsSourceHeight = 0;
+
+static constexpr uint32_t kLetterboxColor = 0x000000FF;
+
+void MakeOutputMapping(OutputMapping* mapping, int outputWidth, int outputHeight, Boolean bilinear)
+{
+	GAME_ASSERT(outputWidth > 0 && outputHeight > 0);
+
+	int contentWidth;
+	int contentHeight;
+	int integerScale = std::min(outputWidth / VISIBLE_WIDTH, outputHeight / VISIBLE_HEIGHT);
+
+	if (!bilinear && integerScale >= 1)
+	{
+		contentWidth = VISIBLE_WIDTH * integerScale;
+		contentHeight = VISIBLE_HEIGHT * integerScale;
+	}
+	else
+	{
+		// Also used if the output is too small for integer scaling
+		integerScale = 0;
+
+		if (outputWidth * VISIBLE_HEIGHT <= outputHeight * VISIBLE_WIDTH)
+		{
+			contentWidth = outputWidth;
+			contentHeight = std::max(1, outputWidth * VISIBLE_HEIGHT / VISIBLE_WIDTH);
+		}
+		else
+		{
+			contentWidth = std::max(1, outputHeight * VISIBLE_WIDTH / VISIBLE_HEIGHT);
+			contentHeight = outputHeight;
+		}
+	}
+
+	mapping->outputWidth	= outputWidth;
+	mapping->outputHeight	= outputHeight;
+	mapping->contentLeft	= (outputWidth - contentWidth) / 2;
+	mapping->contentTop		= (outputHeight - contentHeight) / 2;
+	mapping->contentWidth	= contentWidth;
+	mapping->contentHeight	= contentHeight;
+	mapping->integerScale	= integerScale;
+}
+
+static void MakeTaps(std::vector<uint32_t>& taps, int dstSize, int srcSize)
+{
+	taps.resize(dstSize);
+
+	for (int i = 0; i < dstSize; i++)
+	{
+		// Center of output pixel i, in 24.8 source coordinates
+		int64_t pos = ((2 * (int64_t) i + 1) * srcSize * 256 + dstSize) / (2 * (int64_t) dstSize) - 128;
+		pos = std::clamp<int64_t>(pos, 0, (srcSize - 1) * 256);
+
+		int index = (int) (pos >> 8);
+		int weight = (int) (pos & 0xFF);
+
+		// Never sample past the last pixel
+		if (index == srcSize - 1)
+		{
+			index--;
+			weight = 256;
+		}
+
+		taps[i] = (uint32_t) index | ((uint32_t) weight << 16);
+	}
+}
+
+static void UpdateOutputTaps(const OutputMapping* mapping)
+{
+	if (gTapsSourceWidth == VISIBLE_WIDTH
+		&& gTapsSourceHeight == VISIBLE_HEIGHT
+		&& 0 == memcmp(&gTapsMapping, mapping, sizeof(OutputMapping)))
+	{
+		return;
+	}
+
+	MakeTaps(gColumnTaps, mapping->contentWidth, VISIBLE_WIDTH);
+	MakeTaps(gRowTaps, mapping->contentHeight, VISIBLE_HEIGHT);
+
+	gTapsMapping = *mapping;
+	gTapsSourceWidth = VISIBLE_WIDTH;
+	gTapsSourceHeight = VISIBLE_HEIGHT;
+}
+
+// Finds the output rows that depend on source rows [top, bottom).
+// If every source row changed, that's the whole output, bars included.
+void GetOutputRowsForSourceRows(const OutputMapping* mapping, int top, int bottom, int* outTop, int* outBottom)
+{
+	if (top <= 0 && bottom >= VISIBLE_HEIGHT)
+	{
+		*outTop = 0;
+		*outBottom = mapping->outputHeight;
+	}
+	else if (mapping->integerScale)
+	{
+		*outTop = mapping->contentTop + top * mapping->integerScale;
+		*outBottom = mapping->contentTop + bottom * mapping->integerScale;
+	}
+	else
+	{
+		UpdateOutputTaps(mapping);
+
+		// Rows are sorted by source position, so the matching rows are contiguous
+		int first = 0;
+		int last = mapping->contentHeight;
+
+		while (first < last && (int) (gRowTaps[first] & 0xFFFF) + 1 < top)
+			first++;
+		while (last > first && (int) (gRowTaps[last-1] & 0xFFFF) >= bottom)
+			last--;
+
+		*outTop = mapping->contentTop + first;
+		*outBottom = mapping->contentTop + last;
+	}
+
+	if (*outTop >= *outBottom)
+	{
+		*outTop = *outBottom = 0;
+	}
+}
+
+static inline uint32_t LerpColor(uint32_t a, uint32_t b, uint32_t weight)
+{
+	// Two 8-bit channels per 16-bit lane; a*(256-w) + b*w + 128 (rounding) can't overflow a lane
+	uint32_t rb = ((a & 0x00FF00FF) * (256 - weight) + (b & 0x00FF00FF) * weight + 0x00800080) >> 8;
+	uint32_t ag = (((a >> 8) & 0x00FF00FF) * (256 - weight) + ((b >> 8) & 0x00FF00FF) * weight + 0x00800080) >> 8;
+	return (rb & 0x00FF00FF) | ((ag & 0x00FF00FF) << 8);
+}
+
+static void ResampleRow(uint32_t* out, const uint32_t* src, const OutputMapping* mapping)
+{
+	uint32_t* content = out + mapping->contentLeft;
+	int k = mapping->integerScale;
+
+	std::fill(out, content, kLetterboxColor);
+	std::fill(content + mapping->contentWidth, out + mapping->outputWidth, kLetterboxColor);
+
+	if (k)
+	{
+		for (int x = 0; x < VISIBLE_WIDTH; x++)
+		{
+			std::fill(content + x*k, content + (x+1)*k, src[x]);
+		}
+	}
+	else
+	{
+		const uint32_t* taps = gColumnTaps.data();
+
+		for (int x = 0; x < mapping->contentWidth; x++)
+		{
+			const uint32_t* p = src + (taps[x] & 0xFFFF);
+			content[x] = LerpColor(p[0], p[1], taps[x] >> 16);
+		}
+	}
+}
+
+static void ResampleBand(void* userData, int begin, int end, int workerNum)
+{
+	const RGBATarget* target = (const RGBATarget*) userData;
+	const OutputMapping* mapping = target->output;
+
+	int windowRows[kScalerWindowRows] = { -1, -1, -1 };
+	uint32_t* blendedRow = gScratchRows.data() + (workerNum * kScratchRowsPerWorker + kScalerWindowRows) * VISIBLE_WIDTH;
+
+	for (int outY = target->firstOutputRow + begin; outY < target->firstOutputRow + end; outY++)
+	{
+		uint32_t* out = (uint32_t*) (target->pixels + (outY - target->firstOutputRow) * target->pitch);
+		int contentY = outY - mapping->contentTop;
+
+		if (contentY < 0 || contentY >= mapping->contentHeight)
+		{
+			std::fill(out, out + mapping->outputWidth, kLetterboxColor);
+			continue;
+		}
+
+		const uint32_t* src;
+
+		if (mapping->integerScale)
+		{
+			src = GetScalerSourceRow(workerNum, contentY / mapping->integerScale, target, windowRows);
+		}
+		else
+		{
+			int y = gRowTaps[contentY] & 0xFFFF;
+			uint32_t weight = gRowTaps[contentY] >> 16;
+
+			if (weight == 0)
+			{
+				src = GetScalerSourceRow(workerNum, y, target, windowRows);
+			}
+			else if (weight == 256)
+			{
+				src = GetScalerSourceRow(workerNum, y+1, target, windowRows);
+			}
+			else
+			{
+				const uint32_t* upper = GetScalerSourceRow(workerNum, y  , target, windowRows);
+				const uint32_t* lower = GetScalerSourceRow(workerNum, y+1, target, windowRows);
+
+				for (int x = 0; x < VISIBLE_WIDTH; x++)
+				{
+					blendedRow[x] = LerpColor(upper[x], lower[x], weight);
+				}
+
+				src = blendedRow;
+			}
+		}
+
+		ResampleRow(out, src, mapping);
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+void CheckFramebufferConversionState(void)
+{
+	if (gConvertedFilterDithering == gGamePrefs.filterDithering
+		&& gConvertedScalingType == gGamePrefs.scalingType
+		&& 0 == memcmp(gConvertedPalette, gGamePalette, sizeof(GamePalette)))
+	{
+		return;
+	}
+
+	// A new palette affects every pixel
+	memcpy(gConvertedPalette, gGamePalette, sizeof(GamePalette));
+	gConvertedFilterDithering = gGamePrefs.filterDithering;
+	gConvertedScalingType = gGamePrefs.scalingType;
+	MarkFramebufferDirty();
+}
+
+void BeginFramebufferConversion(const RGBATarget* target)
+{
+	GAME_ASSERT_MESSAGE(gConversionJob == kJobHandle_None, "Previous conversion still in flight");
+	GAME_ASSERT(target->scale >= 1 && target->scale <= 3);
+	GAME_ASSERT(target->scale != 3 || IsEdgeAwareScaling(target->scalingType));
+	GAME_ASSERT(target->firstRow >= 0 && target->firstRow + target->numRows <= VISIBLE_HEIGHT);
+
+	if (!gExpandPalette)
+	{
+		SelectFilterKernels();
+	}
+
+	size_t rowsNeeded = GetJobSystemWorkerCount() * kScratchRowsPerWorker * VISIBLE_WIDTH;
+	if (gScratchRows.size() < rowsNeeded)
+	{
+		gScratchRows.resize(rowsNeeded);
+	}
+
+	size_t bitsNeeded = GetJobSystemWorkerCount() * 2 * (GetDitherBitsWordCount(VISIBLE_WIDTH) + 2);
+	if (gScratchBits.size() < bitsNeeded)
+	{
+		gScratchBits.resize(bitsNeeded);
+	}
+
+	UpdatePixelPairLUT(target->palette, target->filterDithering);
+
+#if _DEBUG
+	gDitherVerifyPhase = (gDitherVerifyPhase + 1) % kDitherVerifyInterval;
+#endif
+
+	if (target->fusedPlayfield)
+	{
+		GAME_ASSERT(target->firstRow <= PF_WINDOW_TOP && PF_WINDOW_TOP + PF_WINDOW_HEIGHT <= target->firstRow + target->numRows);
+
+		// The scalers & the resampler also read rows that belong to other workers' bands,
+		// so only the plain row converter can copy the playfield as it goes.
+		if (target->output || (IsEdgeAwareScaling(target->scalingType) && target->scale > 1))
+		{
+			for (int y = 0; y < PF_WINDOW_HEIGHT; y++)
+				CopyPlayfieldRow(target->playfieldLeft, target->playfieldTop, y);
+		}
+	}
+
+	// 'target' must stay valid until FinishFramebufferConversion
+	if (target->output)
+	{
+		UpdateOutputTaps(target->output);
+
+		int numWorkers = GetJobSystemWorkerCount();
+		int rowsPerBand = (target->numOutputRows + numWorkers - 1) / numWorkers;
+		gConversionJob = ParallelForAsync(target->numOutputRows, rowsPerBand, ResampleBand, (void*) target);
+	}
+	else if (IsEdgeAwareScaling(target->scalingType) && target->scale > 1)
+	{
+		// One band per worker, so that few source rows get converted twice at band boundaries
+		int numWorkers = GetJobSystemWorkerCount();
+		int rowsPerBand = (target->numRows + numWorkers - 1) / numWorkers;
+		gConversionJob = ParallelForAsync(target->numRows, rowsPerBand, ScaleBand, (void*) target);
+	}
+	else
+	{
+		gConversionJob = ParallelForAsync(target->numRows, kRowsPerTask, ConvertRowChunk, (void*) target);
+	}
+}
+
+void GrowDirtyRowsForScaling(uint8_t* dirtyRows)
+{
+	if (!IsEdgeAwareScaling(gGamePrefs.scalingType))
+	{
+		return;
+	}
+
+	// Each output row of the edge-aware scalers depends on its neighbors too.
+	// Rows marked 1 are the originally dirty ones; their neighbors get kDirtyRow_Neighbor so they don't spread further.
+	for (int y = 0; y < VISIBLE_HEIGHT; y++)
+	{
+		if (dirtyRows[y] != 1)
+			continue;
+
+		if (y > 0 && !dirtyRows[y-1])
+			dirtyRows[y-1] = kDirtyRow_Neighbor;
+
+		if (y < VISIBLE_HEIGHT-1 && !dirtyRows[y+1])
+			dirtyRows[y+1] = kDirtyRow_Neighbor;
+	}
+}
+
+void FinishFramebufferConversion(void)
+{
+	WaitForJob(gConversionJob);
+	gConversionJob = kJobHandle_None;
+}
@@ -0,0 +1,431 @@
+// JOB SYSTEM
+// This file is part of Mighty Mike. https://github.com/jorio/mightymike
+//
+// Fixed pool of worker threads shared by the whole engine.
+//
+// ParallelFor pushes one task covering the entire range onto the caller's deque.
+// Whoever runs a task keeps splitting it in half, pushing the upper half back
+// onto its own deque, until the range is no bigger than the grain size.
+// Idle workers steal the oldest (= biggest) pending halves from other workers.
+//
+// Deques are Chase-Lev work-stealing deques (see Lê, Pop, Cohen & Zappa Nardelli,
+// "Correct and Efficient Work-Stealing for Weak Memory Models", PPoPP 2013).
+// The owner pushes/pops at the bottom without locking; thieves CAS the top.
+//
+// Idle workers spin for a little while before parking on a condition variable,
+// so back-to-back jobs (e.g. one per present) don't pay for futex wakeups.
+//
+// Nothing may be thrown out of a worker thread (that would std::terminate), so
+// RunTask catches whatever a task throws and parks it in the job. WaitForJob
+// rethrows it on the thread that waits on the job once every task is done.
+// Assertions that fail on a helper thread are forwarded the same way, so their
+// alert box is shown by the waiting thread.
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <condition_variable>
+#include <exception>
+#include <utility>
+
+#if !_WIN32
+	#include <pthread.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#include <immintrin.h>
+#endif
+
+extern "C"
+{
+	#include "externs.h"
+	#include "misc.h"
+	#include "jobsystem.h"
+}
+
+static constexpr int kDequeCapacity		= 1024;			// must be a power of two
+static constexpr int kMaxJobs			= 16;			// max jobs in flight at once
+static constexpr int kSpinIterations	= 1000;			// idle polls before a worker parks
+
+// A task is packed into 64 bits so deque slots can be plain atomics:
+// [job slot:8][begin:28][end:28]
+static constexpr int kTaskRangeBits		= 28;
+static constexpr uint64_t kTaskRangeMask	= (1ull << kTaskRangeBits) - 1;
+
+struct Job
+{
+	JobFunc				func;
+	void*				userData;
+	int					grainSize;
+	std::atomic<int>	remaining;			// items not processed yet
+	std::atomic<bool>	inUse;
+	std::atomic<bool>	failed;				// set by the first task that throws
+	std::exception_ptr	error;				// what it threw; rethrown by WaitForJob
+};
+
+// Thrown by DoAssert on a helper thread; the waiting thread turns it back into a DoAssert
+struct WorkerAssert
+{
+	const char*			msg;
+	const char*			file;
+	int					line;
+};
+
+class WorkDeque
+{
+	alignas(64) std::atomic<int64_t>	top{0};
+	alignas(64) std::atomic<int64_t>	bottom{0};
+	std::atomic<uint64_t>				tasks[kDequeCapacity];
+
+public:
+	// Owner only
+	void Push(uint64_t task)
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		GAME_ASSERT_MESSAGE(b - t < kDequeCapacity, "Job deque overflow");
+
+		tasks[b & (kDequeCapacity-1)].store(task, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_release);		// publish task (and the job it refers to) to thieves
+	}
+
+	// Owner only
+	bool Pop(uint64_t& task)
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if (t > b)							// empty
+		{
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return false;
+		}
+
+		task = tasks[b & (kDequeCapacity-1)].load(std::memory_order_relaxed);
+
+		if (t == b)							// last task: race against thieves for it
+		{
+			bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+
+		return true;
+	}
+
+	// Any thread
+	bool Steal(uint64_t& task)
+	{
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+
+		if (t >= b)							// empty
+			return false;
+
+		task = tasks[t & (kDequeCapacity-1)].load(std::memory_order_relaxed);
+		return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	}
+};
+
+struct alignas(64) Worker
+{
+	WorkDeque			deque;
+	uint32_t			randomState;
+};
+
+static Worker*						gWorkers = nullptr;
+static int							gNumWorkers = 0;
+static std::vector<std::thread>		gWorkerThreads;
+static Job							gJobs[kMaxJobs];
+
+static std::atomic<uint32_t>		gWorkEpoch{0};			// bumped whenever new work is submitted
+static std::atomic<int>				gNumParkedWorkers{0};
+static std::atomic<bool>			gQuitWorkers{false};
+static std::mutex					gParkMutex;
+static std::condition_variable		gParkCondition;
+
+static thread_local int				tWorkerNum = -1;		// 0 is the thread that called InitJobSystem
+
+// ----------------------------------------------------------------------------
+
+static inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	_mm_pause();
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+	__asm__ __volatile__("yield");
+#else
+	std::this_thread::yield();
+#endif
+}
+
+static inline uint64_t MakeTask(int jobSlot, int begin, int end)
+{
+	return ((uint64_t) jobSlot << (2*kTaskRangeBits)) | ((uint64_t) begin << kTaskRangeBits) | (uint64_t) end;
+}
+
+static inline int TaskJobSlot(uint64_t task)	{ return (int) (task >> (2*kTaskRangeBits)); }
+static inline int TaskBegin(uint64_t task)		{ return (int) ((task >> kTaskRangeBits) & kTaskRangeMask); }
+static inline int TaskEnd(uint64_t task)		{ return (int) (task & kTaskRangeMask); }
+
+// ----------------------------------------------------------------------------
+
+static bool TryGetTask(int workerNum, uint64_t& task)
+{
+	Worker& self = gWorkers[workerNum];
+
+	if (self.deque.Pop(task))
+		return true;
+
+	// Own deque is empty; go steal from someone else, starting at a random victim
+	self.randomState = self.randomState * 1664525u + 1013904223u;
+	int victim = (int) ((self.randomState >> 16) % (uint32_t) gNumWorkers);
+
+	for (int i = 0; i < gNumWorkers; i++, victim = (victim + 1) % gNumWorkers)
+	{
+		if (victim != workerNum && gWorkers[victim].deque.Steal(task))
+			return true;
+	}
+
+	return false;
+}
+
+static void RunTask(int workerNum, uint64_t task)
+{
+	int jobSlot	= TaskJobSlot(task);
+	int begin	= TaskBegin(task);
+	int end		= TaskEnd(task);
+	Job& job	= gJobs[jobSlot];
+
+	try
+	{
+		// Keep the lower half for ourselves and expose the upper half to thieves
+		while (end - begin > job.grainSize)
+		{
+			int mid = begin + (end - begin) / 2;
+			gWorkers[workerNum].deque.Push(MakeTask(jobSlot, mid, end));
+			end = mid;
+		}
+
+		job.func(job.userData, begin, end, workerNum);
+	}
+	catch (...)
+	{
+		// Keep the first error; [begin, end) still counts as done so the waiter doesn't hang
+		if (!job.failed.exchange(true, std::memory_order_relaxed))
+			job.error = std::current_exception();
+	}
+
+	// Don't touch the job after this -- it may get recycled as soon as remaining hits 0
+	job.remaining.fetch_sub(end - begin, std::memory_order_acq_rel);
+}
+
+static void WakeWorkers()
+{
+	gWorkEpoch.fetch_add(1, std::memory_order_seq_cst);
+
+	if (gNumParkedWorkers.load(std::memory_order_seq_cst) > 0)
+	{
+		std::scoped_lock lock(gParkMutex);
+		gParkCondition.notify_all();
+	}
+}
+
+static void WorkerThread(int workerNum)
+{
+#if !_WIN32 && _GNU_SOURCE
+	char name[32];
+	snprintf(name, sizeof(name), "Worker %02d", workerNum);
+	pthread_setname_np(pthread_self(), name);
+#endif
+
+	tWorkerNum = workerNum;
+
+	int idlePolls = 0;
+
+	while (!gQuitWorkers.load(std::memory_order_relaxed))
+	{
+		// Read epoch BEFORE looking for work so we can't miss a submission that happens in-between
+		uint32_t epoch = gWorkEpoch.load(std::memory_order_seq_cst);
+
+		uint64_t task;
+		if (TryGetTask(workerNum, task))
+		{
+			RunTask(workerNum, task);
+			idlePolls = 0;
+		}
+		else if (++idlePolls < kSpinIterations)
+		{
+			CpuRelax();
+		}
+		else
+		{
+			std::unique_lock lock(gParkMutex);
+			gNumParkedWorkers.fetch_add(1, std::memory_order_seq_cst);
+			gParkCondition.wait(lock, [=] { return gQuitWorkers || epoch != gWorkEpoch.load(std::memory_order_seq_cst); });
+			gNumParkedWorkers.fetch_sub(1, std::memory_order_seq_cst);
+			idlePolls = 0;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+static int SubmitJob(int count, int grainSize, JobFunc func, void* userData)
+{
+	int jobSlot = -1;
+
+	for (int i = 0; i < kMaxJobs && jobSlot < 0; i++)
+	{
+		bool expected = false;
+		if (gJobs[i].inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+			jobSlot = i;
+	}
+	GAME_ASSERT_MESSAGE(jobSlot >= 0, "Too many jobs in flight");
+
+	Job& job		= gJobs[jobSlot];
+	job.func		= func;
+	job.userData	= userData;
+	job.grainSize	= grainSize;
+	job.remaining.store(count, std::memory_order_release);
+
+	gWorkers[tWorkerNum].deque.Push(MakeTask(jobSlot, 0, count));
+	WakeWorkers();
+
+	return jobSlot;
+}
+
+static void WaitForJobSlot(int jobSlot)
+{
+	Job& job = gJobs[jobSlot];
+
+	// Help out instead of blocking. This may run tasks from other jobs, which is fine.
+	while (job.remaining.load(std::memory_order_acquire) > 0)
+	{
+		uint64_t task;
+		if (TryGetTask(tWorkerNum, task))
+			RunTask(tWorkerNum, task);
+		else
+			CpuRelax();
+	}
+
+	std::exception_ptr error = std::exchange(job.error, nullptr);
+	job.failed.store(false, std::memory_order_relaxed);
+	job.inUse.store(false, std::memory_order_release);
+
+	if (error)
+	{
+		try
+		{
+			std::rethrow_exception(error);
+		}
+		catch (const WorkerAssert& a)
+		{
+			DoAssert(a.msg, a.file, a.line);		// show the alert from this thread instead
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+void InitJobSystem(int numWorkers)
+{
+	GAME_ASSERT_MESSAGE(!gWorkers, "Job system already initialized");
+
+	if (numWorkers < 1)
+		numWorkers = 1;
+
+	gNumWorkers = numWorkers;
+	gWorkers = new Worker[numWorkers];
+	gQuitWorkers = false;
+
+	for (int i = 0; i < numWorkers; i++)
+	{
+		gWorkers[i].randomState = 0x9E3779B9u * (i + 1);
+	}
+
+	tWorkerNum = 0;					// calling thread participates as worker 0
+
+	for (int i = 1; i < numWorkers; i++)
+	{
+		gWorkerThreads.emplace_back(WorkerThread, i);
+	}
+}
+
+void ShutdownJobSystem(void)
+{
+	if (!gWorkers)
+	{
+		return;
+	}
+
+	{
+		std::scoped_lock lock(gParkMutex);
+		gQuitWorkers = true;
+		gWorkEpoch.fetch_add(1, std::memory_order_seq_cst);
+		gParkCondition.notify_all();
+	}
+
+	for (auto& t : gWorkerThreads)
+	{
+		t.join();
+	}
+
+	gWorkerThreads.clear();
+
+	delete[] gWorkers;
+	gWorkers = nullptr;
+	gNumWorkers = 0;
+}
+
+int GetJobSystemWorkerCount(void)
+{
+	return gNumWorkers;
+}
+
+void ForwardWorkerAssert(const char* msg, const char* file, int line)
+{
+	if (tWorkerNum > 0)
+		throw WorkerAssert{msg, file, line};
+}
+
+void ParallelFor(int count, int grainSize, JobFunc func, void* userData)
+{
+	WaitForJob(ParallelForAsync(count, grainSize, func, userData));
+}
+
+JobHandle ParallelForAsync(int count, int grainSize, JobFunc func, void* userData)
+{
+	GAME_ASSERT_MESSAGE(gWorkers, "Job system not initialized");
+	GAME_ASSERT_MESSAGE(tWorkerNum >= 0, "ParallelFor called from a thread that isn't part of the job system");
+	GAME_ASSERT((uint64_t) count <= kTaskRangeMask);
+
+	if (count <= 0)
+		return kJobHandle_None;
+
+	if (grainSize < 1)
+		grainSize = 1;
+
+	// Not worth waking anyone up -- just do it now
+	if (gNumWorkers == 1 || count <= grainSize)
+	{
+		func(userData, 0, count, tWorkerNum);
+		return kJobHandle_None;
+	}
+
+	return SubmitJob(count, grainSize, func, userData);
+}
+
+void WaitForJob(JobHandle job)
+{
+	if (job == kJobHandle_None)
+		return;
+
+	GAME_ASSERT(job >= 0 && job < kMaxJobs);
+	GAME_ASSERT_MESSAGE(tWorkerNum >= 0, "WaitForJob called from a thread that isn't part of the job system");
+	WaitForJobSlot(job);
+}
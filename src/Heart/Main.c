@@ -273,8 +273,8 @@ static void UpdateSimAndRenderFixedFrame(void)
 	DrawObjects();
 	DisplayPlayfield();
 	UpdateInfoBar();
+	PresentIndexedFramebuffer();							// before erasing: with gFusedPlayfield, the present reads the PF buffer
 	EraseObjects();
-	PresentIndexedFramebuffer();
 	RegulateSpeed(GAME_SPEED_MICROSECONDS);
 }
 
@@ -328,8 +328,8 @@ static void UpdateSimAndRenderTweenedFrames(void)
 		ScrollPlayfield();									// also tweens camera position
 		DrawObjects();
 		DisplayPlayfield();
+		PresentIndexedFramebuffer();						// before erasing: with gFusedPlayfield, the present reads the PF buffer
 		EraseObjects();
-		PresentIndexedFramebuffer();
 
 		uint32_t now = SDL_GetTicks();
 		gTimeSinceSim += now - startOfFrameTimestamp;
@@ -397,6 +397,8 @@ long	r;
 #endif
 
 	} while (!gGlobFlag_MeDoneDead && !gAbortGameFlag && !gFinishedArea && !gAbortDemoFlag);
+
+	StopInterlacing();									// screens after this one draw every line
 }
 
 
@@ -620,6 +622,7 @@ FSSpec		mySpec;
 			NumObjects = 				gPlayerSaveData[gCurrentPlayer].numObjects;
 			FirstNodePtr = 				gPlayerSaveData[gCurrentPlayer].firstNodePtr;
 			gMyNodePtr =  				gPlayerSaveData[gCurrentPlayer].myNodePtr;
+			RebuildObjectZIndex();									// list was swapped out from under the Z index
 		}
 		else
 			gPlayerSaveData[gCurrentPlayer].newAreaFlag = false;		// not new anymore
@@ -676,6 +679,7 @@ FSSpec		mySpec;
 				diff = tempPtr - theNode->SHAPE_HEADER_Ptr;								// calc how far it moved
 				theNode->SHAPE_HEADER_Ptr = tempPtr;									// reset to new location
 				theNode->AnimsList = (Ptr)(theNode->AnimsList + diff);					// adjust anim ptr by the distance
+				theNode->FrameDesc = FindFrameDescriptor(theNode->SpriteGroupNum, theNode->Type, theNode->CurrentFrame);	// frame table was rebuilt too
 			}
 
 					/* ADJUST ALL ITEM INDEX PTRS */
@@ -1253,6 +1257,7 @@ static void InitDefaultPrefs(void)
 	gGamePrefs.scalingType = kScaling_Stretch;
 	gGamePrefs.uncappedFramerate = true;
 	gGamePrefs.filterDithering = true;
+	gGamePrefs.pipelinedPresent = false;
 	gGamePrefs.music = true;
 	gGamePrefs.interpolateAudio = true;
 	gGamePrefs.gameTitlePowerPete = false;
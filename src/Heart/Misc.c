@@ -21,6 +21,7 @@
 #include "objecttypes.h"
 #include "cinema.h"
 #include "externs.h"
+#include "jobsystem.h"
 
 /****************************/
 /*    PROTOTYPES             */
@@ -106,6 +107,7 @@ void DoAlert(const char* s)
 
 void DoAssert(const char* msg, const char* file, int line)
 {
+	ForwardWorkerAssert(msg, file, line);			// on a worker thread, the thread waiting on the job reports it instead
 	fprintf(stderr, "MIKE ASSERTION FAILED: %s - %s:%d\n", msg, file, line);
 	static char alertbuf[1024];
 	snprintf(alertbuf, 1024, "%s\n%s:%d", msg, file, line);
@@ -727,6 +729,8 @@ void FillThermometer(short percent)
 			gScreenLookUpTable[y][left] = borderColor;						// left line
 			gScreenLookUpTable[y][right-1] = borderColor;					// right line
 		}
+
+		MarkFramebufferRowsDirty(top, height+1);
 	}
 	else																	// fill thermometer
 	{
@@ -737,6 +741,8 @@ void FillThermometer(short percent)
 		{
 			memset(gScreenLookUpTable[y] + left+1, fillColor, filledWidth);
 		}
+
+		MarkFramebufferRowsDirty(top+1, height-1);
 	}
 
 	PresentIndexedFramebuffer();
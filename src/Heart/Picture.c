@@ -67,6 +67,7 @@ void LoadImage(const char* fileName, short showMode)
 	{
 		destPtr = gIndexedFramebuffer;
 		destRowBytes = VISIBLE_WIDTH;
+		MarkFramebufferDirty();
 	}
 
 				/* OFFSET DESTINATION POINTER */
@@ -124,6 +125,8 @@ void LoadBorderImage(void)
 	case PFSIZE_WIDE:
 		path = ":images:border832.tga";
 		flags |= LOADIMAGE_ALIGNBOTTOM;
+		if (VISIBLE_WIDTH > 832)							// custom --pf-size: clear the infobar strip on either side of the image
+			BlankEntireScreenArea();
 		break;
 	default:
 		GAME_ASSERT_MESSAGE(false, "Unknown pfSize!");
@@ -153,8 +153,8 @@ static MenuItem gVideoMenu[] =
 			.caption = "upscaling",
 			.callback = OnChangeIntegerScaling,
 			.valuePtr = &gGamePrefs.scalingType,
-			.numChoices = 3,
-			.choices = { "crisp", "fast stretch", "hq stretch" },
+			.numChoices = 7,
+			.choices = { "crisp", "fast stretch", "hq stretch", "scale2x", "scale3x", "cpu integer", "cpu bilinear" },
 		}
 	},
 	{
@@ -177,6 +177,26 @@ static MenuItem gVideoMenu[] =
 			.choices = { "   raw", "   filtered" },
 		}
 	},
+	{
+		.type = kMenuItem_Cycler, .cycler =
+		{
+			.caption = "frame latency",
+			.callback = nil,
+			.valuePtr = &gGamePrefs.pipelinedPresent,
+			.numChoices = 2,
+			.choices = { "none: synchronous", "1 frame: pipelined" },
+		}
+	},
+	{
+		.type = kMenuItem_Cycler, .cycler =
+		{
+			.caption = "interlacing",
+			.callback = nil,
+			.valuePtr = &gGamePrefs.interlaceMode,
+			.numChoices = 2,
+			.choices = { "no", "yes" },
+		}
+	},
 	{ .type = kMenuItem_Action, .button = { .caption = "done", .callback = OnDone } },
 	{ .type = kMenuItem_END_SENTINEL },
 };
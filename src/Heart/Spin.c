@@ -375,6 +375,7 @@ void DrawSpinFrame(Ptr srcPtr)
 
 		uint8_t* destPtr = gScreenLookUpTable[y+gSpinY] + gSpinX + x;	// point to screen
 		memcpy(destPtr, srcPtr, size);						// copy data
+		MarkFramebufferRowsDirty(y+gSpinY, 1);
 		srcPtr += size;
 
 	}while(--numChunks);
@@ -42,10 +42,16 @@ int				VISIBLE_WIDTH = 640;			// dimensions of visible area (MULTIPLE OF 4!!!)
 int				VISIBLE_HEIGHT = 480;
 
 uint8_t*		gIndexedFramebuffer = nil;		// [VISIBLE_WIDTH * VISIBLE_HEIGHT]
-uint8_t*		gRGBAFramebuffer = nil;			// [VISIBLE_WIDTH * VISIBLE_HEIGHT * 4]
-uint8_t*		gRGBAFramebufferX2 = nil;		// [VISIBLE_WIDTH * VISIBLE_HEIGHT * 4 * 4]
+uint8_t*		gRGBAFramebuffer = nil;			// [VISIBLE_WIDTH * VISIBLE_HEIGHT * 4] only if texture can't be locked
+uint8_t*		gRGBAFramebufferX2 = nil;		// [VISIBLE_WIDTH * VISIBLE_HEIGHT * 4 * 4] only if texture can't be locked
+uint8_t*		gRGBAFramebufferX3 = nil;		// [VISIBLE_WIDTH * VISIBLE_HEIGHT * 4 * 9] only if texture can't be locked
 
-uint8_t*		gRowDitherStrides = nil;		// for dithering filter
+
+uint8_t*		gFramebufferDirtyRows = nil;	// [VISIBLE_HEIGHT] nonzero if row changed since last present
+static uint8_t*	gFramebufferUniformRows = nil;	// [VISIBLE_HEIGHT] nonzero if row is known to be a single color
+
+static int		gInterlaceTop = 0;				// while interlacing, odd rows in [top, bottom) are left blank
+static int		gInterlaceBottom = 0;
 
 										// GAME STUFF
 Handle			gBackgroundHandle = nil;
@@ -67,10 +73,41 @@ Ptr				*gPFLookUpTable = nil;
 Ptr				*gPFCopyLookUpTable = nil;
 Ptr				*gPFMaskLookUpTable = nil;
 
+uint64_t*		gPFDirtyTiles = nil;			// one bit per PF buffer tile drawn over by a sprite since the last erase
+int				gPFDirtyTileWords = 0;			// words per tile row in gPFDirtyTiles
+
+uint64_t*		gUpdateRegionBits = nil;		// one bit per offscreen pixel to copy on the next DumpUpdateRegions
+int				gUpdateRegionWords = 0;			// words per row in gUpdateRegionBits
+
 static const uint32_t	kDebugTextUpdateInterval = 200;
+static const uint32_t	kHeadlessReportInterval = 1000;	// headless: print the debug text to stdout this often
 static uint32_t			gDebugTextFrameAccumulator = 0;
 static uint32_t			gDebugTextLastUpdatedAt = 0;
+static uint64_t			gDebugTextPresentTime = 0;		// performance counter ticks spent in PresentIndexedFramebuffer
 static char				gDebugTextBuffer[1024];
+static long				gNumFramesPresented = 0;
+
+static const int		kHeadlessOutputWidth = 1920;		// pretend output size when there's no renderer
+static const int		kHeadlessOutputHeight = 1080;
+
+static const int		kDirtyRunMergeGap = 8;			// merge dirty row runs separated by fewer clean rows than this
+
+static Boolean			gTextureLockFailed = false;		// renderer can't lock streaming textures, use SDL_UpdateTexture instead
+
+										// PRESENT PIPELINE
+static uint8_t*			gPresentFramebuffer = nil;		// [VISIBLE_WIDTH * VISIBLE_HEIGHT] copy of gIndexedFramebuffer for pipelined presents
+static uint8_t*			gPresentDirtyRows = nil;		// [VISIBLE_HEIGHT] rows being converted for the pending present
+static GamePalette		gPresentPalette;
+static RGBATarget		gPresentTarget;
+static Boolean			gPresentPending = false;		// a frame was handed to the converters but hasn't been shown yet
+static Boolean			gPresentTextureLocked = false;
+static int				gPresentOutputTop = 0;			// output rows written by the converters (output-sized scaling only)
+static int				gPresentOutputBottom = 0;
+
+										// OUTPUT-SIZED SCALING
+static OutputMapping	gOutputMapping;					// outputWidth is 0 unless the texture is output-sized
+static uint8_t*			gRGBAOutputFramebuffer = nil;	// only if texture can't be locked
+static size_t			gRGBAOutputFramebufferSize = 0;
 
 
 /********************** ERASE BACKGROUND BUFFER ********************/
@@ -115,6 +152,8 @@ void DumpGameWindow(void)
 		destPtr += VISIBLE_WIDTH;				// Bump to start of next row
 		srcPtr += OFFSCREEN_WIDTH;
 	}
+
+	MarkFramebufferDirty();
 }
 
 
@@ -133,7 +172,11 @@ void DumpBackground(void)
 
 /******************** ERASE STORE **************************/
 //
-// Blanks alternate lines for interlace mode
+// Blanks alternate lines for interlace mode.
+//
+// The blank lines are then left alone until StopInterlacing:
+// DisplayPlayfield & DumpUpdateRegions skip them, and the present code
+// neither converts nor uploads them again unless something else draws over them.
 //
 
 void EraseStore(void)
@@ -157,10 +200,44 @@ long		size;
 			memset(destPtr, 0xFE, PF_WINDOW_WIDTH);		// dark grey
 			destPtr += VISIBLE_WIDTH;
 		}
+
+		MarkFramebufferRowsDirty(PF_WINDOW_TOP, PF_WINDOW_HEIGHT);
+
+		gInterlaceTop = PF_WINDOW_TOP;
+		gInterlaceBottom = PF_WINDOW_TOP + PF_WINDOW_HEIGHT;
+
+		if (PF_WINDOW_LEFT == 0 && PF_WINDOW_WIDTH == VISIBLE_WIDTH)	// blank lines span the entire row
+		{
+			for (int y = gInterlaceTop+1; y < gInterlaceBottom; y += 2)
+				gFramebufferUniformRows[y] = true;
+		}
 	}
 }
 
 
+/******************** IS INTERLACED ROW **************************/
+//
+// True if framebuffer row y is one of the blank lines while interlacing.
+//
+
+Boolean IsInterlacedRow(int y)
+{
+	return y >= gInterlaceTop && y < gInterlaceBottom && ((y - gInterlaceTop) & 1);
+}
+
+
+/******************** STOP INTERLACING **************************/
+//
+// Lets DisplayPlayfield & co. draw every line again. Call when leaving the playfield.
+//
+
+void StopInterlacing(void)
+{
+	gInterlaceTop = 0;
+	gInterlaceBottom = 0;
+}
+
+
 /******************* BLANK ENTIRE SCREEN AREA ********************/
 
 void BlankEntireScreenArea(void)
@@ -178,9 +255,15 @@ Rect	r;
 
 void InitScreenBuffers(void)
 {
+	FlushPresentPipeline();								// workers may still be reading the old buffers
+
 	CHECKED_DISPOSEPTR(gIndexedFramebuffer);
+	CHECKED_DISPOSEPTR(gPresentFramebuffer);
 	CHECKED_DISPOSEPTR(gRGBAFramebuffer);
 	CHECKED_DISPOSEPTR(gRGBAFramebufferX2);
+	CHECKED_DISPOSEPTR(gRGBAFramebufferX3);
+	CHECKED_DISPOSEPTR(gRGBAOutputFramebuffer);
+	gRGBAOutputFramebufferSize = 0;
 
 	CHECKED_DISPOSEHANDLE(gOffScreenHandle);
 	CHECKED_DISPOSEHANDLE(gBackgroundHandle);
@@ -195,7 +278,14 @@ void InitScreenBuffers(void)
 	CHECKED_DISPOSEHANDLE(gPFBufferCopyHandle);
 	CHECKED_DISPOSEHANDLE(gPFMaskBufferHandle);
 
-	CHECKED_DISPOSEPTR(gRowDitherStrides);
+	CHECKED_DISPOSEPTR(gPFDirtyTiles);
+	CHECKED_DISPOSEPTR(gUpdateRegionBits);
+
+	CHECKED_DISPOSEPTR(gFramebufferDirtyRows);
+	CHECKED_DISPOSEPTR(gFramebufferUniformRows);
+	CHECKED_DISPOSEPTR(gPresentDirtyRows);
+
+	StopInterlacing();
 
 					/* MAKE INDEXED FRAMEBUFFER */
 
@@ -205,13 +295,10 @@ void InitScreenBuffers(void)
 	// Clear to black
 	memset(gIndexedFramebuffer, 0xFF, VISIBLE_WIDTH * VISIBLE_HEIGHT);
 
-					/* MAKE RGBA FRAMEBUFFER */
+	gPresentFramebuffer = (uint8_t*) NewPtrClear(VISIBLE_WIDTH * VISIBLE_HEIGHT);
+	GAME_ASSERT(gPresentFramebuffer);
 
-	gRGBAFramebuffer = (uint8_t*) NewPtrClear(VISIBLE_WIDTH * VISIBLE_HEIGHT * 4);
-	GAME_ASSERT(gRGBAFramebuffer);
-
-	gRGBAFramebufferX2 = (uint8_t*) NewPtrClear((VISIBLE_WIDTH*2) * (VISIBLE_HEIGHT*2) * 4);
-	GAME_ASSERT(gRGBAFramebufferX2);
+	// RGBA framebuffers are only allocated on demand if the renderer doesn't support texture locking
 
 					/* MAKE OFFSCREEN DRAW BUFFER */
 
@@ -278,9 +365,30 @@ void InitScreenBuffers(void)
 		gPFMaskLookUpTable[i]	= (*gPFMaskBufferHandle)	+ (i * PF_BUFFER_WIDTH);
 	}
 
-					/* BUILD DITHERING FILTER BUFFER */
+					/* MAKE DIRTY TILE BITMAP */
+
+	gPFDirtyTileWords = (PF_TILE_WIDTH + 63) / 64;
+	gPFDirtyTiles = (uint64_t*) NewPtrClear(PF_TILE_HEIGHT * gPFDirtyTileWords * sizeof(uint64_t));
+	GAME_ASSERT(gPFDirtyTiles);
+
+					/* MAKE UPDATE REGION BITMAP */
+
+	gUpdateRegionWords = (OFFSCREEN_WIDTH + 63) / 64;
+	gUpdateRegionBits = (uint64_t*) NewPtrClear(OFFSCREEN_HEIGHT * gUpdateRegionWords * sizeof(uint64_t));
+	GAME_ASSERT(gUpdateRegionBits);
+
+					/* BUILD DIRTY ROW TABLE */
+
+	gFramebufferDirtyRows = (uint8_t*) NewPtrClear(VISIBLE_HEIGHT);
+	GAME_ASSERT(gFramebufferDirtyRows);
 
-	gRowDitherStrides = (uint8_t*) NewPtrClear(gNumThreads * VISIBLE_WIDTH);
+	gFramebufferUniformRows = (uint8_t*) NewPtrClear(VISIBLE_HEIGHT);
+	GAME_ASSERT(gFramebufferUniformRows);
+
+	MarkFramebufferDirty();
+
+	gPresentDirtyRows = (uint8_t*) NewPtrClear(VISIBLE_HEIGHT);
+	GAME_ASSERT(gPresentDirtyRows);
 }
 
 
@@ -349,6 +457,39 @@ long	x,y;
 
 		destPtr += VISIBLE_WIDTH;					// next row
 	}
+
+	MarkFramebufferRowsDirty(y, theArea.bottom - y);
+}
+
+#pragma mark -
+
+/******************** MARK FRAMEBUFFER ROWS DIRTY ********************/
+//
+// Anything that writes to gIndexedFramebuffer must flag the rows it touched,
+// otherwise PresentIndexedFramebuffer won't convert & upload them.
+//
+
+void MarkFramebufferRowsDirty(int top, int numRows)
+{
+	if (top < 0)									// clip to framebuffer
+	{
+		numRows += top;
+		top = 0;
+	}
+
+	if (top + numRows > VISIBLE_HEIGHT)
+		numRows = VISIBLE_HEIGHT - top;
+
+	if (numRows <= 0 || !gFramebufferDirtyRows)
+		return;
+
+	memset(gFramebufferDirtyRows + top, 1, numRows);
+	memset(gFramebufferUniformRows + top, 0, numRows);
+}
+
+void MarkFramebufferDirty(void)
+{
+	MarkFramebufferRowsDirty(0, VISIBLE_HEIGHT);
 }
 
 #pragma mark -
@@ -375,13 +516,7 @@ void SetScreenOffsetFor640x480(void)
 
 void CleanupDisplay(void)
 {
-	ShutdownRenderThreads();
-
-	if (gRowDitherStrides != nil)
-	{
-		DisposePtr((Ptr) gRowDitherStrides);
-		gRowDitherStrides = nil;
-	}
+	FlushPresentPipeline();
 }
 
 /****************** PRESENT FRAMEBUFFER *************************/
@@ -436,10 +571,330 @@ void DumpIndexedTGA(const char* hostPath, int width, int height, const char* dat
 }
 #endif
 
+static int GetTextureScale(void)
+{
+	switch (gGamePrefs.scalingType)
+	{
+		case kScaling_HQStretch:
+		case kScaling_Scale2x:
+			return 2;
+
+		case kScaling_Scale3x:
+			return 3;
+
+		default:
+			return 1;
+	}
+}
+
+static void GetOutputSize(int* width, int* height)
+{
+	if (gHeadless)
+	{
+		*width = kHeadlessOutputWidth;
+		*height = kHeadlessOutputHeight;
+	}
+	else
+	{
+		SDL_GetRendererOutputSize(gSDLRenderer, width, height);
+	}
+}
+
+static Boolean IsOutputSizedScaling(void)
+{
+	return gGamePrefs.scalingType == kScaling_OutputInteger
+		|| gGamePrefs.scalingType == kScaling_OutputBilinear;
+}
+
+/********************** BEGIN PRESENT CONVERSION *********************/
+//
+// Hands gPresentTarget to the converters, along with the playfield copy
+// if DisplayPlayfield left it to us.
+//
+
+static void BeginPresentConversion(void)
+{
+	gPresentTarget.fusedPlayfield = TakePendingPlayfieldCopy(&gPresentTarget.playfieldLeft, &gPresentTarget.playfieldTop);
+
+	BeginFramebufferConversion(&gPresentTarget);
+}
+
+/********************** BEGIN OUTPUT-SIZED PRESENT *********************/
+//
+// Tail end of BeginPresent when the texture has the renderer's output size.
+// The converters write whole output rows (letterbox bars included),
+// so only the span of output rows affected by source rows [top, bottom) is touched.
+//
+
+static void BeginOutputSizedPresent(int top, int bottom)
+{
+	int outTop = 0;
+	int outBottom = 0;
+	GetOutputRowsForSourceRows(&gOutputMapping, top, bottom, &outTop, &outBottom);
+
+	gPresentOutputTop = outTop;
+	gPresentOutputBottom = outBottom;
+
+	if (outTop == outBottom)
+		return;
+
+	gPresentTarget.output			= &gOutputMapping;
+	gPresentTarget.scale			= 1;
+	gPresentTarget.firstRow			= top;
+	gPresentTarget.numRows			= bottom-top;
+	gPresentTarget.firstOutputRow	= outTop;
+	gPresentTarget.numOutputRows	= outBottom-outTop;
+
+	if (!gTextureLockFailed)
+	{
+		void* pixels = NULL;
+		int pitch = 0;
+		SDL_Rect rect = { 0, outTop, gOutputMapping.outputWidth, outBottom-outTop };
+
+		if (0 == SDL_LockTexture(gSDLTexture, &rect, &pixels, &pitch))
+		{
+			gPresentTarget.pixels	= (uint8_t*) pixels;
+			gPresentTarget.pitch	= pitch;
+			gPresentTextureLocked	= true;
+		}
+		else
+		{
+			gTextureLockFailed = true;
+		}
+	}
+
+	if (!gPresentTextureLocked)
+	{
+		int pitch = gOutputMapping.outputWidth * 4;
+		size_t size = (size_t) pitch * gOutputMapping.outputHeight;
+
+		if (gRGBAOutputFramebufferSize < size)
+		{
+			CHECKED_DISPOSEPTR(gRGBAOutputFramebuffer);
+			gRGBAOutputFramebuffer = (uint8_t*) NewPtrClear(size);
+			GAME_ASSERT(gRGBAOutputFramebuffer);
+			gRGBAOutputFramebufferSize = size;
+		}
+
+		gPresentTarget.pixels	= gRGBAOutputFramebuffer + outTop * pitch;
+		gPresentTarget.pitch	= pitch;
+	}
+
+	BeginPresentConversion();
+}
+
+/********************** BEGIN PRESENT *********************/
+//
+// Hands the rows that changed since the last present over to the converters.
+//
+// If async, returns without waiting for the conversion to complete; the game
+// is then free to draw the next frame while the workers convert this one.
+// The frame is shown by FinishPresent.
+//
+
+static void BeginPresent(Boolean async)
+{
+	GAME_ASSERT(!gPresentPending);
+
+	CheckFramebufferConversionState();					// new palette? mark every row dirty
+
+	memcpy(gPresentDirtyRows, gFramebufferDirtyRows, VISIBLE_HEIGHT);
+	memset(gFramebufferDirtyRows, 0, VISIBLE_HEIGHT);
+
+	GrowDirtyRowsForScaling(gPresentDirtyRows);			// edge-aware scalers look at neighboring rows
+
+	gPresentPending = true;
+	gPresentTarget.pixels = NULL;
+
+			/* FIND SPAN OF DIRTY ROWS */
+
+	int top = 0;
+	int bottom = VISIBLE_HEIGHT;
+
+	while (top < bottom && !gPresentDirtyRows[top])
+		top++;
+	while (bottom > top && !gPresentDirtyRows[bottom-1])
+		bottom--;
+
+	if (top == bottom)									// nothing changed, just show the texture again
+		return;
+
+			/* SNAPSHOT INDEXED PIXELS & PALETTE */
+
+	// The game keeps drawing into gIndexedFramebuffer during an async conversion,
+	// so the workers get their own copy of the span they need.
+	// The filters may also peek at the row just above and below the span.
+	const uint8_t* indexed = gIndexedFramebuffer;
+	if (async)
+	{
+		FlushPendingPlayfieldCopy();					// ...and the PF buffer will have changed by the time they get to it
+
+		int copyTop = top > 0 ? top-1 : 0;
+		int copyBottom = bottom < VISIBLE_HEIGHT ? bottom+1 : VISIBLE_HEIGHT;
+		memcpy(gPresentFramebuffer + copyTop*VISIBLE_WIDTH, gIndexedFramebuffer + copyTop*VISIBLE_WIDTH, (copyBottom-copyTop)*VISIBLE_WIDTH);
+		indexed = gPresentFramebuffer;
+	}
+
+	memcpy(gPresentPalette, gGamePalette, sizeof(GamePalette));
+
+	int scale = GetTextureScale();
+
+	gPresentTarget.indexed			= indexed;
+	gPresentTarget.dirtyRows		= gPresentDirtyRows;
+	gPresentTarget.palette			= gPresentPalette;
+	gPresentTarget.filterDithering	= gGamePrefs.filterDithering;
+	gPresentTarget.scalingType		= gGamePrefs.scalingType;
+	gPresentTarget.scale			= scale;
+	gPresentTarget.output			= NULL;
+
+	if (gOutputMapping.outputWidth)
+	{
+		BeginOutputSizedPresent(top, bottom);
+		return;
+	}
+
+			/* ZERO-COPY: CONVERT STRAIGHT INTO LOCKED TEXTURE */
+
+	if (!gTextureLockFailed)
+	{
+		void* pixels = NULL;
+		int pitch = 0;
+		SDL_Rect rect = { 0, top*scale, VISIBLE_WIDTH*scale, (bottom-top)*scale };
+
+		if (0 == SDL_LockTexture(gSDLTexture, &rect, &pixels, &pitch))
+		{
+			// Locked pixels are write-only and may not hold the texture's previous contents,
+			// so every row in the locked rect must be converted, even the clean ones.
+			// Clean single-color rows (blank interlace lines) can just be filled, though.
+			for (int y = top; y < bottom; y++)
+			{
+				if (!gPresentDirtyRows[y])
+					gPresentDirtyRows[y] = gFramebufferUniformRows[y] ? kDirtyRow_Uniform : 1;
+			}
+
+			gPresentTarget.pixels	= (uint8_t*) pixels;
+			gPresentTarget.pitch	= pitch;
+			gPresentTarget.firstRow	= top;
+			gPresentTarget.numRows	= bottom-top;
+			gPresentTextureLocked	= true;
+		}
+		else
+		{
+			gTextureLockFailed = true;
+		}
+	}
+
+			/* FALLBACK: CONVERT TO RGBA FRAMEBUFFER, UPLOAD IN FINISHPRESENT */
+
+	if (!gPresentTextureLocked)
+	{
+		int pitch = VISIBLE_WIDTH * 4 * scale;
+		uint8_t** bufferPtr = &gRGBAFramebuffer;
+		if (scale == 2)
+			bufferPtr = &gRGBAFramebufferX2;
+		else if (scale == 3)
+			bufferPtr = &gRGBAFramebufferX3;
+
+		if (!*bufferPtr)
+		{
+			*bufferPtr = (uint8_t*) NewPtrClear(pitch * VISIBLE_HEIGHT * scale);
+			GAME_ASSERT(*bufferPtr);
+		}
+
+		gPresentTarget.pixels	= *bufferPtr;
+		gPresentTarget.pitch	= pitch;
+		gPresentTarget.firstRow	= 0;
+		gPresentTarget.numRows	= VISIBLE_HEIGHT;
+	}
+
+	BeginPresentConversion();
+}
+
+/********************** FINISH PRESENT *********************/
+//
+// Waits for the converters, gets their output into the texture and shows it.
+//
+
+static void FinishPresent(void)
+{
+	if (!gPresentPending)
+		return;
+
+	FinishFramebufferConversion();
+
+	if (gHeadless)
+	{
+		// No texture: the converted frame just stays in the RGBA framebuffer
+		gPresentPending = false;
+		return;
+	}
+
+	if (gPresentTextureLocked)
+	{
+		SDL_UnlockTexture(gSDLTexture);
+		gPresentTextureLocked = false;
+	}
+	else if (gPresentTarget.pixels && gPresentTarget.output)
+	{
+		// Output-sized fallback buffer: upload the span the converters wrote
+		SDL_Rect rect = { 0, gPresentOutputTop, gOutputMapping.outputWidth, gPresentOutputBottom-gPresentOutputTop };
+		SDL_UpdateTexture(gSDLTexture, &rect, gPresentTarget.pixels, gPresentTarget.pitch);
+	}
+	else if (gPresentTarget.pixels)
+	{
+		const int scale = gPresentTarget.scale;
+		const int pitch = gPresentTarget.pitch;
+
+		// While interlacing, every other row is clean; don't merge runs across them or we'd upload everything
+		const int mergeGap = gInterlaceBottom > gInterlaceTop ? 1 : kDirtyRunMergeGap;
+
+		for (int y = 0; y < VISIBLE_HEIGHT; y++)
+		{
+			if (!gPresentDirtyRows[y])
+				continue;
+
+			int runStart = y;
+			int runEnd = y + 1;							// exclusive
+
+			for (y++; y < VISIBLE_HEIGHT && y - runEnd < mergeGap; y++)
+			{
+				if (gPresentDirtyRows[y])
+					runEnd = y + 1;
+			}
+
+			SDL_Rect rect = { 0, runStart*scale, VISIBLE_WIDTH*scale, (runEnd-runStart)*scale };
+			SDL_UpdateTexture(gSDLTexture, &rect, gPresentTarget.pixels + rect.y*pitch, pitch);
+
+			y = runEnd - 1;								// resume scanning right after the run
+		}
+	}
+
+	SDL_RenderClear(gSDLRenderer);
+	SDL_RenderCopy(gSDLRenderer, gSDLTexture, NULL, NULL);
+	SDL_RenderPresent(gSDLRenderer);
+
+	gPresentPending = false;
+}
+
+/********************** FLUSH PRESENT PIPELINE *********************/
+//
+// Shows the pending frame, if any. Call this before touching anything
+// the converters might still be using (texture, buffers, VISIBLE_WIDTH...)
+//
+
+void FlushPresentPipeline(void)
+{
+	FinishPresent();
+}
+
+/********************** PRESENT INDEXED FRAMEBUFFER *********************/
+
 void PresentIndexedFramebuffer(void)
 {
 	if (gScreenBlankedFlag)		// CLUT was blanked (in-between a fade-out and a fade-in), ignore
 	{
+		FlushPendingPlayfieldCopy();	// nothing gets converted, so the playfield copy can't be left to the converters
+		FlushPresentPipeline();	// but do show the last frame we were working on
 		return;
 	}
 
@@ -450,20 +905,33 @@ void PresentIndexedFramebuffer(void)
 //	}
 
 	//-------------------------------------------------------------------------
-	// Convert indexed to RGBA, with optional post-processing
+	// Show previous frame if pipelining, then start converting this one
 
-	ConvertFramebufferToRGBA();
+	uint64_t presentStart = SDL_GetPerformanceCounter();
 
-	//-------------------------------------------------------------------------
-	// Update SDL texture and swap buffers
+	FinishPresent();
 
-	if (gGamePrefs.scalingType == kScaling_HQStretch)
-		SDL_UpdateTexture(gSDLTexture, NULL, gRGBAFramebufferX2, VISIBLE_WIDTH*4*2);
-	else
-		SDL_UpdateTexture(gSDLTexture, NULL, gRGBAFramebuffer, VISIBLE_WIDTH*4);
-	SDL_RenderClear(gSDLRenderer);
-	SDL_RenderCopy(gSDLRenderer, gSDLTexture, NULL, NULL);
-	SDL_RenderPresent(gSDLRenderer);
+	// Output-sized texture must follow the renderer (window resized, fullscreen toggled, moved to a HiDPI display...)
+	if (gOutputMapping.outputWidth)
+	{
+		int outputWidth = 0;
+		int outputHeight = 0;
+		GetOutputSize(&outputWidth, &outputHeight);
+
+		if (outputWidth != gOutputMapping.outputWidth || outputHeight != gOutputMapping.outputHeight)
+			OnChangeIntegerScaling();
+	}
+
+	BeginPresent(gGamePrefs.pipelinedPresent);
+	FlushPendingPlayfieldCopy();						// in case BeginPresent had nothing to convert
+
+	if (!gGamePrefs.pipelinedPresent)
+	{
+		FinishPresent();
+	}
+
+	gDebugTextPresentTime += SDL_GetPerformanceCounter() - presentStart;
+	gNumFramesPresented++;
 
 	//-------------------------------------------------------------------------
 	// Update debug info
@@ -471,46 +939,105 @@ void PresentIndexedFramebuffer(void)
 	gDebugTextFrameAccumulator++;
 	uint32_t ticksNow = SDL_GetTicks();
 	uint32_t ticksElapsed = ticksNow - gDebugTextLastUpdatedAt;
-	if (ticksElapsed >= kDebugTextUpdateInterval)
+	if (ticksElapsed >= (gHeadless ? kHeadlessReportInterval : kDebugTextUpdateInterval))
 	{
-		if (gGamePrefs.debugInfoInTitleBar && !gGamePrefs.fullscreen)
+		if (gHeadless || (gGamePrefs.debugInfoInTitleBar && !gGamePrefs.fullscreen))
 		{
 			float fps = 1000 * gDebugTextFrameAccumulator / (float)ticksElapsed;
+			float presentMs = 1000.0f * gDebugTextPresentTime / (float)SDL_GetPerformanceFrequency() / gDebugTextFrameAccumulator;
 			snprintf(
 					gDebugTextBuffer, sizeof(gDebugTextBuffer),
-					"Mighty Mike %s - thr:%d - fps:%d - objs:%ld - x:%ld y:%ld",
+					"Mighty Mike %s - thr:%d %s %s %s %s - %ldx%ld fps:%d frame:%.2fms present:%.2fms - objs:%ld erase:%ld/%ld dump:%ld/%ld shapes:%ldK/%ldK - x:%ld y:%ld",
 					PROJECT_VERSION,
 					gNumThreads,
+					GetPaletteKernelName(),
+					gHeadless ? "headless" : gTextureLockFailed ? "copy" : "lock",
+					gGamePrefs.pipelinedPresent ? "pipe" : "sync",
+					GetPixelPairLUTStatus(),
+					(long) VISIBLE_WIDTH,
+					(long) VISIBLE_HEIGHT,
 					(int)roundf(fps),
+					ticksElapsed / (float)gDebugTextFrameAccumulator,		// frame cost, to compare playfield sizes
+					presentMs,
 					NumObjects,
+					gPFTileEraseBytes / (long) gDebugTextFrameAccumulator,		// per frame: dirty tiles vs. per-sprite rects
+					gPFRectEraseBytes / (long) gDebugTextFrameAccumulator,
+					gUpdateRegionBytes / (long) gDebugTextFrameAccumulator,		// per frame: coalesced vs. raw update rects
+					gUpdateRectBytes / (long) gDebugTextFrameAccumulator,
+					gShapeDataBytes / 1024,										// shape memory as loaded vs. after BuildFrameTable
+					gShapeTableBytes / 1024,
 					gMyX,
 					gMyY
 			);
-			SDL_SetWindowTitle(gSDLWindow, gDebugTextBuffer);
+
+			if (gHeadless)
+				printf("%s\n", gDebugTextBuffer);
+			else
+				SDL_SetWindowTitle(gSDLWindow, gDebugTextBuffer);
 		}
 		gDebugTextFrameAccumulator = 0;
+		gDebugTextPresentTime = 0;
+		gPFTileEraseBytes = 0;
+		gPFRectEraseBytes = 0;
+		gUpdateRegionBytes = 0;
+		gUpdateRectBytes = 0;
 		gDebugTextLastUpdatedAt = ticksNow;
 	}
+
+	//-------------------------------------------------------------------------
+	// Timed runs (--frames N) end here
+
+	if (gQuitAfterFrames > 0 && gNumFramesPresented >= gQuitAfterFrames)
+	{
+		printf("Presented %ld frames, quitting.\n", gNumFramesPresented);
+		CleanQuit();
+	}
 }
 
 void SetFullscreenMode(void)
 {
+	FlushPresentPipeline();				// texture may still be locked
+
+	if (gHeadless)
+		return;
+
 	SDL_SetWindowFullscreen(gSDLWindow, gGamePrefs.fullscreen ? SDL_WINDOW_FULLSCREEN_DESKTOP : 0);
 }
 
 void OnChangeIntegerScaling(void)
 {
+	FlushPresentPipeline();				// texture may still be locked
+
 	bool crisp = true;
 	int multiplier = 1;
+	int textureWidth;
+	int textureHeight;
+
+	memset(&gOutputMapping, 0, sizeof(gOutputMapping));
+
+	if (IsOutputSizedScaling())
+	{
+		// The CPU scales to the exact output size, SDL just copies the texture 1:1
+		int outputWidth = VISIBLE_WIDTH;
+		int outputHeight = VISIBLE_HEIGHT;
+		GetOutputSize(&outputWidth, &outputHeight);
+
+		if (outputWidth < 1 || outputHeight < 1)		// minimized
+		{
+			outputWidth = VISIBLE_WIDTH;
+			outputHeight = VISIBLE_HEIGHT;
+		}
 
-	if (gGamePrefs.scalingType == kScaling_HQStretch || gGamePrefs.scalingType == kScaling_Stretch)
+		MakeOutputMapping(&gOutputMapping, outputWidth, outputHeight, gGamePrefs.scalingType == kScaling_OutputBilinear);
+		crisp = false;		// integer scale must be off for the texture to fill the output
+	}
+	else if (gGamePrefs.scalingType != kScaling_PixelPerfect)
 	{
 		// Stretch: don't use nearest-neighbor
 		crisp = false;
 
-		// HQ stretch
-		if (gGamePrefs.scalingType == kScaling_HQStretch)
-			multiplier = 2;
+		// HQ stretch, Scale2x, Scale3x: upscale on the CPU first
+		multiplier = GetTextureScale();
 	}
 	else
 	{
@@ -530,6 +1057,14 @@ void OnChangeIntegerScaling(void)
 		}
 	}
 
+	if (gHeadless)
+	{
+		// No texture to make; convert into the RGBA framebuffers in memory
+		gTextureLockFailed = true;
+		MarkFramebufferDirty();
+		return;
+	}
+
 	// Nuke old texture
 	if (gSDLTexture)
 	{
@@ -537,20 +1072,43 @@ void OnChangeIntegerScaling(void)
 		gSDLTexture = NULL;
 	}
 
-	// Set scaling quality before creating texture
-	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, crisp ? "nearest" : "best");
+	if (gOutputMapping.outputWidth)
+	{
+		textureWidth = gOutputMapping.outputWidth;
+		textureHeight = gOutputMapping.outputHeight;
+
+		// Texture pixels map 1:1 to output pixels; keep SDL from rescaling anything
+		SDL_RenderSetLogicalSize(gSDLRenderer, 0, 0);
+		SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+	}
+	else
+	{
+		textureWidth = VISIBLE_WIDTH * multiplier;
+		textureHeight = VISIBLE_HEIGHT * multiplier;
+
+		SDL_RenderSetLogicalSize(gSDLRenderer, VISIBLE_WIDTH, VISIBLE_HEIGHT);
+
+		// Set scaling quality before creating texture
+		SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, crisp ? "nearest" : "best");
+	}
 
 	// Recreate texture
 	gSDLTexture = SDL_CreateTexture(
 			gSDLRenderer,
 			SDL_PIXELFORMAT_RGBA8888,
 			SDL_TEXTUREACCESS_STREAMING,
-			VISIBLE_WIDTH * multiplier,
-			VISIBLE_HEIGHT * multiplier
+			textureWidth,
+			textureHeight
 			);
 	GAME_ASSERT(gSDLTexture);
 
 	// Set integer scaling setting
 	SDL_RenderSetIntegerScale(gSDLRenderer, crisp);
+
+	// New texture is blank, so the next present must upload everything
+	MarkFramebufferDirty();
+
+	// Give texture locking another chance with the new texture
+	gTextureLockFailed = false;
 }
 
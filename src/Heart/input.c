@@ -144,6 +144,11 @@ void UpdateInput(void)
 			}
 			break;
 
+		case SDL_RENDER_TARGETS_RESET:
+		case SDL_RENDER_DEVICE_RESET:
+			MarkFramebufferDirty();			// texture contents may be lost, re-upload everything
+			break;
+
 		case SDL_TEXTINPUT:
 			memcpy(gTextInput, event.text.text, sizeof(gTextInput));
 			_Static_assert(sizeof(gTextInput) == sizeof(event.text.text), "size mismatch: gTextInput / event.text.text");
@@ -4,6 +4,9 @@
 #include "PommeGraphics.h"
 
 #include <SDL.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <thread>
 
@@ -12,6 +15,11 @@
 #include <unistd.h>
 #endif
 
+extern "C"
+{
+	#include "jobsystem.h"
+}
+
 extern "C"
 {
 	// Satisfy externs in game code
@@ -25,6 +33,61 @@ extern "C"
 	void GameMain(void);
 
 	int gNumThreads = 0;
+
+	// No window, renderer or texture; frames are only converted in memory (--headless or MIGHTYMIKE_HEADLESS=1)
+	Boolean gHeadless = false;
+
+	// If nonzero, quit after presenting this many frames (--frames N)
+	long gQuitAfterFrames = 0;
+
+	// Copy each shape frame's pixel & mask rows into one interleaved block at load time (--interleave-shapes)
+	Boolean gInterleaveShapes = false;
+
+	// Leave the playfield copy to the present, whose worker threads copy each row just before converting it (--fused-playfield)
+	Boolean gFusedPlayfield = false;
+
+	// If nonzero, the wide playfield is sized to fit this many pixels instead of its 27x14-tile preset (--pf-size WxH)
+	long gCustomPlayfieldWidth = 0;
+	long gCustomPlayfieldHeight = 0;
+}
+
+static void ParseCommandLine(int argc, const char** argv)
+{
+	const char* headlessEnv = getenv("MIGHTYMIKE_HEADLESS");
+	if (headlessEnv && headlessEnv[0] && 0 != strcmp(headlessEnv, "0"))
+	{
+		gHeadless = true;
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (0 == strcmp(argv[i], "--headless"))
+		{
+			gHeadless = true;
+		}
+		else if (0 == strcmp(argv[i], "--frames") && i + 1 < argc)
+		{
+			gQuitAfterFrames = atol(argv[++i]);
+		}
+		else if (0 == strcmp(argv[i], "--interleave-shapes"))
+		{
+			gInterleaveShapes = true;
+		}
+		else if (0 == strcmp(argv[i], "--fused-playfield"))
+		{
+			gFusedPlayfield = true;
+		}
+		else if (0 == strcmp(argv[i], "--pf-size") && i + 1 < argc)
+		{
+			long w = 0;
+			long h = 0;
+			if (2 == sscanf(argv[++i], "%ldx%ld", &w, &h) && w > 0 && h > 0)
+			{
+				gCustomPlayfieldWidth = w;
+				gCustomPlayfieldHeight = h;
+			}
+		}
+	}
 }
 
 static fs::path FindGameData()
@@ -62,12 +125,25 @@ static fs::path FindGameData()
 
 int CommonMain(int argc, const char** argv)
 {
+	ParseCommandLine(argc, argv);
+
+	if (gHeadless)
+	{
+		// Must be set before SDL brings up its subsystems (Pomme::Init opens the audio device)
+		SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+		SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+	}
+
 	gNumThreads = (int) std::thread::hardware_concurrency();
-	if (gNumThreads >= 32)
-		gNumThreads = 32;
-	else if (gNumThreads <= 0)
+	if (gNumThreads <= 0)
 		gNumThreads = 1;
 
+	// Spin up worker threads (the main thread counts as one of them).
+	// The guard joins them even if something throws out of CommonMain;
+	// joinable std::threads would otherwise std::terminate during static destruction.
+	InitJobSystem(gNumThreads);
+	struct JobSystemGuard { ~JobSystemGuard() { ShutdownJobSystem(); } } jobSystemGuard;
+
 	// Start our "machine"
 	Pomme::Init();
 
@@ -78,27 +154,31 @@ int CommonMain(int argc, const char** argv)
 	if (0 != SDL_Init(SDL_INIT_VIDEO))
 		throw std::runtime_error("Couldn't initialize SDL video subsystem.");
 
-	// Create window
-	gSDLWindow = SDL_CreateWindow(
-			"Mighty Mike",
-			SDL_WINDOWPOS_UNDEFINED,
-			SDL_WINDOWPOS_UNDEFINED,
-			640,
-			480,
-			SDL_WINDOW_RESIZABLE | SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI);
-	if (!gSDLWindow)
-		throw std::runtime_error("Couldn't create SDL window.");
+	// Create window (unless headless -- the game then leaves gSDLWindow, gSDLRenderer and gSDLTexture null)
+	if (!gHeadless)
+	{
+		gSDLWindow = SDL_CreateWindow(
+				"Mighty Mike",
+				SDL_WINDOWPOS_UNDEFINED,
+				SDL_WINDOWPOS_UNDEFINED,
+				640,
+				480,
+				SDL_WINDOW_RESIZABLE | SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI);
+		if (!gSDLWindow)
+			throw std::runtime_error("Couldn't create SDL window.");
 
-	gSDLRenderer = SDL_CreateRenderer(gSDLWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-	if (!gSDLRenderer)
-		throw std::runtime_error("Couldn't create SDL renderer.");
-	// The texture bound to the renderer is created in-game after loading the prefs.
+		gSDLRenderer = SDL_CreateRenderer(gSDLWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+		if (!gSDLRenderer)
+			throw std::runtime_error("Couldn't create SDL renderer.");
+		// The texture bound to the renderer is created in-game after loading the prefs.
 
-	SDL_RenderSetLogicalSize(gSDLRenderer, 640, 480);
+		SDL_RenderSetLogicalSize(gSDLRenderer, 640, 480);
+	}
 
 	fs::path dataPath = FindGameData();
 #if !(__APPLE__)
-	Pomme::Graphics::SetWindowIconFromIcl8Resource(gSDLWindow, 400);
+	if (gSDLWindow)
+		Pomme::Graphics::SetWindowIconFromIcl8Resource(gSDLWindow, 400);
 #endif
 
 	// Init joystick subsystem
@@ -123,6 +203,7 @@ int CommonMain(int argc, const char** argv)
 	}
 
 	// Clean up
+	ShutdownJobSystem();
 	Pomme::Shutdown();
 
 	return 0;
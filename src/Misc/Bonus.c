@@ -302,6 +302,8 @@ const int	radarCenterY = gGamePrefs.pfSize == PFSIZE_SMALL ? RADAR_CENTER_Y : ((
 	Ptr destPtr = (Ptr) gScreenLookUpTable[radarCenterY - height/2] + (radarCenterX - width/2);
 	Ptr srcPtr = *imageHandle;
 
+	MarkFramebufferRowsDirty(radarCenterY - height/2, height);
+
 	for (int i = 0; i < height; i++)
 	{
 		memcpy(destPtr, srcPtr, width);
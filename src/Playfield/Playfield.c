@@ -27,8 +27,22 @@
 #include "enemy5.h"
 #include "racecar.h"
 #include "externs.h"
+#include "jobsystem.h"
+#include <stdio.h>
 #include <string.h>
 
+/****************************/
+/*    PROTOTYPES            */
+/****************************/
+
+static void BuildTileMasks(void);
+static void DisposeTileMasks(void);
+static void BuildTileAnimIndex(void);
+static void DrawExposedTileRows(void* userData, int begin, int end, int workerNum);
+static void DrawExposedTiles(long rowsAbove, long rowsBelow, long colsLeft, long colsRight);
+static void ScanExposedItems(void);
+static void CopyPlayfieldToFramebuffer(long left, long top);
+
 /****************************/
 /*    CONSTANTS             */
 /****************************/
@@ -59,8 +73,19 @@ long	PF_WINDOW_LEFT	=	24;				// left MUST be on 4 pixel boundary!!!!!
 
 #define	MAX_PLAYFIELD_WIDTH	1000L		// max tiles wide the PF will ever be
 
+#define	MAX_CUSTOM_PF_TILE_WIDTH	104		// biggest --pf-size view that still fits (with SCROLL_BORDER) in the smallest map (108x100 tiles)
+#define	MAX_CUSTOM_PF_TILE_HEIGHT	96
+
 #define	MAX_TILE_ANIMS	50						// max # of tile anims
 
+#define	MIN_PARALLEL_TILES		64				// fewer exposed tiles than this are drawn on the calling thread
+
+enum											// gTileMaskInfo values that aren't offsets into gTileMasks
+{
+	kTileMask_Solid = -1,						// tile has no xparent colors: mask is all 0xff
+	kTileMask_Empty = -2						// tile is all xparent colors: mask is all 0x00
+};
+
 
 
 
@@ -71,6 +96,9 @@ long	PF_WINDOW_LEFT	=	24;				// left MUST be on 4 pixel boundary!!!!!
 static	Handle			gTileSetHandle = nil;
 static	Ptr				gTilesPtr;
 static	short			*gTileXlatePtr;
+static	int				gNumTileDefinitions = 0;
+static	int32_t			*gTileMaskInfo = nil;			// [gNumTileDefinitions] kTileMask_* or offset of the tile's pixel mask in gTileMasks
+static	Ptr				gTileMasks = nil;				// precomputed pixel masks of the tiles that mix xparent & other colors
 
 Handle			gPlayfieldHandle = nil;
 uint16_t		**gPlayfield = nil;
@@ -86,6 +114,12 @@ long			gScrollRow,gScrollCol,gOldScrollRow,gOldScrollCol;
 
 short			gNumItems = -1;
 static	ObjectEntryType	**gItemLookupTableX = nil;
+
+static	long	gExposedRowsAbove,gExposedRowsBelow;		// # new rows at top/bottom of the view being drawn by DrawExposedTiles
+static	long	gExposedColsLeft,gExposedColsRight;			// # new cols at left/right of the view
+
+static	Boolean	gPlayfieldCopyPending = false;				// DisplayPlayfield left the copy to the present's converters
+static	long	gPendingPlayfieldLeft,gPendingPlayfieldTop;
 ObjectEntryType *gMasterItemList = nil;
 
 TileAttribType	*gTileAttributes;
@@ -107,6 +141,7 @@ static	Ptr				gMaxItemAddress;								// addr of last item in current item list
 // Source port note: moved from TileAnim.c
 static	short			gNumTileAnims;
 static	TileAnimEntryType	gTileAnims[MAX_TILE_ANIMS];
+static	Ptr				gTileAnimIndex = nil;			// holds the rowStart & mapCols tables of every tile anim
 
 
 /**********************/
@@ -176,6 +211,12 @@ static	Boolean	(*gItemAddPtrs[])(ObjectEntryType *) = {
 
 void OnChangePlayfieldSize(void)
 {
+	FlushPresentPipeline();							// converters may still be using VISIBLE_WIDTH/HEIGHT
+	FlushPendingPlayfieldCopy();					// before the PF buffer & screen get reallocated
+
+	if (gCustomPlayfieldWidth && gCustomPlayfieldHeight)	// --pf-size overrides the pfSize pref, which it builds on
+		gGamePrefs.pfSize = PFSIZE_WIDE;
+
 	switch (gGamePrefs.pfSize)
 	{
 	case PFSIZE_SMALL:
@@ -195,6 +236,20 @@ void OnChangePlayfieldSize(void)
 		PF_TILE_HEIGHT	= 14;				// dimensions of scrolling Playfield
 		PF_WINDOW_LEFT	= 0;				// left MUST be on 4 pixel boundary!!!!!
 		PF_WINDOW_TOP	= 0;
+
+		if (gCustomPlayfieldWidth && gCustomPlayfieldHeight)	// derive tile dims from requested pixel size (--pf-size)
+		{
+			long	w = gCustomPlayfieldWidth < 640 ? 640 : gCustomPlayfieldWidth;
+			long	h = gCustomPlayfieldHeight < 480 ? 480 : gCustomPlayfieldHeight;
+
+			PF_TILE_WIDTH	= w / TILE_SIZE + 1;		// view is PF_TILE_WIDTH-1 x PF_TILE_HEIGHT+1 tiles,
+			PF_TILE_HEIGHT	= h / TILE_SIZE - 1;		// i.e. w/TILE_SIZE x h/TILE_SIZE
+
+			if (PF_TILE_WIDTH > MAX_CUSTOM_PF_TILE_WIDTH)
+				PF_TILE_WIDTH = MAX_CUSTOM_PF_TILE_WIDTH;
+			if (PF_TILE_HEIGHT > MAX_CUSTOM_PF_TILE_HEIGHT)
+				PF_TILE_HEIGHT = MAX_CUSTOM_PF_TILE_HEIGHT;
+		}
 		break;
 	default:
 		GAME_ASSERT_MESSAGE(false, "OnChangePlayfieldSize: Unsupported pfSize!");
@@ -214,17 +269,26 @@ void OnChangePlayfieldSize(void)
 	GAME_ASSERT(VISIBLE_WIDTH >= 640);
 	GAME_ASSERT(VISIBLE_HEIGHT >= 480);
 
-	SDL_RenderSetLogicalSize(gSDLRenderer, VISIBLE_WIDTH, VISIBLE_HEIGHT);
+	if (gCustomPlayfieldWidth && gCustomPlayfieldHeight)
+	{
+		printf("--pf-size %ldx%ld: using %dx%d\n",
+				gCustomPlayfieldWidth, gCustomPlayfieldHeight, VISIBLE_WIDTH, VISIBLE_HEIGHT);
+	}
 
-	int currentWindowWidth;
-	int currentWindowHeight;
-	Uint32 windowFlags = SDL_GetWindowFlags(gSDLWindow);
-	SDL_RestoreWindow(gSDLWindow);
-	SDL_GetWindowSize(gSDLWindow, &currentWindowWidth, &currentWindowHeight);
-	SDL_SetWindowSize(gSDLWindow, VISIBLE_WIDTH, VISIBLE_HEIGHT);
-	if (windowFlags & SDL_WINDOW_MAXIMIZED)
+	if (!gHeadless)
 	{
-		SDL_MaximizeWindow(gSDLWindow);
+		SDL_RenderSetLogicalSize(gSDLRenderer, VISIBLE_WIDTH, VISIBLE_HEIGHT);
+
+		int currentWindowWidth;
+		int currentWindowHeight;
+		Uint32 windowFlags = SDL_GetWindowFlags(gSDLWindow);
+		SDL_RestoreWindow(gSDLWindow);
+		SDL_GetWindowSize(gSDLWindow, &currentWindowWidth, &currentWindowHeight);
+		SDL_SetWindowSize(gSDLWindow, VISIBLE_WIDTH, VISIBLE_HEIGHT);
+		if (windowFlags & SDL_WINDOW_MAXIMIZED)
+		{
+			SDL_MaximizeWindow(gSDLWindow);
+		}
 	}
 
 	MakeGameWindow();
@@ -284,7 +348,7 @@ int16_t* tileXparentList		= nil;
 
 			/* GET ENTRY COUNTS */
 
-	/*int numTileDefinitions		=*/   Byteswap16SignedRW(tileSetPtr + offsetToTileDefinitions			- 2	);
+	gNumTileDefinitions					= Byteswap16SignedRW(tileSetPtr + offsetToTileDefinitions			- 2	);
 	int numXlateEntries					= Byteswap16SignedRW(tileSetPtr + offsetToXlateTable				- 2	);
 	int numTileAttributeEntries			= Byteswap16SignedRW(tileSetPtr + offsetToTileAttributes			- 2	);
 	gNumTileAnims						= Byteswap16SignedRW(tileSetPtr + offsetToTileAnimList			- 2	);
@@ -343,6 +407,8 @@ int16_t* tileXparentList		= nil;
 		gTileAnims[i].count = 0;
 		gTileAnims[i].index = 0;
 		gTileAnims[i].defPtr = tileAnimDef;
+		gTileAnims[i].rowStart = nil;
+		gTileAnims[i].mapCols = nil;
 
 		// Advance pointer to next tile anim data
 		currentTileAnimData += 16 + 2*3 + 2*tileAnimDef->numFrames;
@@ -362,6 +428,75 @@ int16_t* tileXparentList		= nil;
 
 		gColorMaskArray[tileXparentList[i]] = false;
 	}
+
+	BuildTileMasks();
+	BuildTileAnimIndex();									// in case the map is already loaded
+}
+
+
+/********************* BUILD TILE MASKS **********************/
+//
+// Sorts every tile definition into solid (no xparent colors), empty (nothing but
+// xparent colors) or mixed, and precomputes the pixel mask of each mixed tile,
+// so DrawATile never has to run pixels through gColorMaskArray.
+//
+
+static void BuildTileMasks(void)
+{
+int		numMixed = 0;
+
+	DisposeTileMasks();
+
+	GAME_ASSERT(gNumTileDefinitions >= 0);
+	GAME_ASSERT(gNumTileDefinitions == 0 ||
+				HandleBoundsCheck(gTileSetHandle, gTilesPtr + (gNumTileDefinitions << (TILE_SIZE_SH*2)) - 1));
+
+	gTileMaskInfo = (int32_t*) NewPtr(sizeof(int32_t) * (gNumTileDefinitions + 1));
+	GAME_ASSERT(gTileMaskInfo);
+
+				/* CLASSIFY TILES */
+
+	for (int t = 0; t < gNumTileDefinitions; t++)
+	{
+		const uint8_t* pixels = (const uint8_t*) gTilesPtr + (t << (TILE_SIZE_SH*2));
+		int numSolid = 0;
+
+		for (int i = 0; i < TILE_SIZE*TILE_SIZE; i++)
+			numSolid += gColorMaskArray[pixels[i]]? 1: 0;
+
+		if (numSolid == TILE_SIZE*TILE_SIZE)
+			gTileMaskInfo[t] = kTileMask_Solid;
+		else if (numSolid == 0)
+			gTileMaskInfo[t] = kTileMask_Empty;
+		else
+			gTileMaskInfo[t] = (numMixed++) * (TILE_SIZE*TILE_SIZE);
+	}
+
+				/* BUILD MASKS OF MIXED TILES */
+
+	gTileMasks = NewPtr(numMixed * (TILE_SIZE*TILE_SIZE) + 1);
+	GAME_ASSERT(gTileMasks);
+
+	for (int t = 0; t < gNumTileDefinitions; t++)
+	{
+		if (gTileMaskInfo[t] < 0)
+			continue;
+
+		const uint8_t* pixels = (const uint8_t*) gTilesPtr + (t << (TILE_SIZE_SH*2));
+		uint8_t* mask = (uint8_t*) gTileMasks + gTileMaskInfo[t];
+
+		for (int i = 0; i < TILE_SIZE*TILE_SIZE; i++)
+			mask[i] = gColorMaskArray[pixels[i]]? 0xff: 0x00;		// 0xff keeps the tile in front of the sprite
+	}
+}
+
+
+/********************* DISPOSE TILE MASKS **********************/
+
+static void DisposeTileMasks(void)
+{
+	CHECKED_DISPOSEPTR(gTileMaskInfo);
+	CHECKED_DISPOSEPTR(gTileMasks);
 }
 
 
@@ -397,6 +532,16 @@ void DisposeCurrentMapData(void)
 		gTileSetHandle = nil;
 	}
 
+	DisposeTileMasks();
+	gNumTileDefinitions = 0;
+
+	CHECKED_DISPOSEPTR(gTileAnimIndex);
+	for (int i = 0; i < gNumTileAnims; i++)
+	{
+		gTileAnims[i].rowStart = nil;
+		gTileAnims[i].mapCols = nil;
+	}
+
 	gNumItems = -1;
 	gMasterItemList = nil;	// this is just a pointer within gPlayfieldHandle, no need to dispose of it
 
@@ -440,6 +585,9 @@ Ptr		bytePtr,pfPtr;
 		tempPtr += gPlayfieldTileWidth;								// next row
 	}
 
+	GAME_ASSERT_MESSAGE(gPlayfieldWidth >= PF_WINDOW_WIDTH + 2*SCROLL_BORDER			// scroll clamps need the view + border to fit
+			&& gPlayfieldHeight >= PF_WINDOW_HEIGHT + 2*SCROLL_BORDER, "Map is smaller than the playfield view!");
+
 
 			/* GET ALTERNATE MAP */
 
@@ -467,6 +615,72 @@ Ptr		bytePtr,pfPtr;
 	gOldScrollY = 0;
 	gTweenedScrollX = 0;
 	gTweenedScrollY = 0;
+
+	BuildTileAnimIndex();
+}
+
+
+/*************** BUILD TILE ANIM INDEX *******************/
+//
+// For each tile anim, lists every map position that holds its base tile,
+// so UpdateTileAnimation only visits those instead of rescanning the view.
+// The map never changes after it's loaded, so this is only done once per map.
+//
+
+static void BuildTileAnimIndex(void)
+{
+long	numMatches = 0;
+
+	CHECKED_DISPOSEPTR(gTileAnimIndex);
+
+	if (gPlayfield == nil || gNumTileAnims == 0)					// need both the map & the tileset
+		return;
+
+				/* COUNT MATCHES */
+
+	for (int i = 0; i < gNumTileAnims; i++)
+	{
+		uint16_t baseTile = gTileAnims[i].defPtr->baseTile;
+
+		for (int row = 0; row < gPlayfieldTileHeight; row++)
+			for (int col = 0; col < gPlayfieldTileWidth; col++)
+				numMatches += (gPlayfield[row][col] & TILENUM_MASK) == baseTile;
+	}
+
+				/* BUILD TABLES */
+
+	long rowStartCount = gNumTileAnims * (gPlayfieldTileHeight + 1);
+
+	gTileAnimIndex = NewPtr(rowStartCount * sizeof(int32_t) + numMatches * sizeof(uint16_t) + 1);
+	GAME_ASSERT(gTileAnimIndex);
+
+	int32_t* rowStart = (int32_t*) gTileAnimIndex;
+	uint16_t* mapCols = (uint16_t*) (rowStart + rowStartCount);
+
+	for (int i = 0; i < gNumTileAnims; i++)
+	{
+		uint16_t baseTile = gTileAnims[i].defPtr->baseTile;
+		int32_t n = 0;
+
+		gTileAnims[i].rowStart = rowStart;
+		gTileAnims[i].mapCols = mapCols;
+
+		for (int row = 0; row < gPlayfieldTileHeight; row++)
+		{
+			rowStart[row] = n;
+
+			for (int col = 0; col < gPlayfieldTileWidth; col++)
+			{
+				if ((gPlayfield[row][col] & TILENUM_MASK) == baseTile)
+					mapCols[n++] = col;
+			}
+		}
+
+		rowStart[gPlayfieldTileHeight] = n;
+
+		rowStart += gPlayfieldTileHeight + 1;
+		mapCols += n;
+	}
 }
 
 
@@ -478,7 +692,6 @@ Ptr		bytePtr,pfPtr;
 
 void InitPlayfield(void)
 {
-long		row,col,x,y,col2;
 long		right,left,top,bottom;
 
 				/* INIT PLAYFIELD CLIPPING REGION */
@@ -529,22 +742,7 @@ long		right,left,top,bottom;
 	gScrollRow = gOldScrollRow = gScrollY>>TILE_SIZE_SH;		// calc scroll tile row/col
 	gScrollCol = gOldScrollCol = gScrollX>>TILE_SIZE_SH;
 
-	row = gScrollRow % PF_TILE_HEIGHT;							// calc row in buffer
-	col = gScrollCol % PF_TILE_WIDTH;							// calc col in buffer
-
-	for (y = 0; y < PF_TILE_HEIGHT; y++)
-	{
-		col2 = col;
-		for (x = 0; x < PF_TILE_WIDTH; x++)
-		{
-			DrawATile(gPlayfield[gScrollRow+y][gScrollCol+x],row,col2,true);
-
-			if (++col2 >= PF_TILE_WIDTH)
-				col2 = 0;
-		}
-		if (++row >= PF_TILE_HEIGHT)
-			row = 0;
-	}
+	DrawExposedTiles(PF_TILE_HEIGHT, 0, 0, 0);					// whole view is new
 
 				/* ADD ITEMS IN THIS AREA */
 
@@ -624,8 +822,7 @@ ObjectEntryType *lastPtr;
 /************************** SCROLL PLAYFIELD ****************************/
 //
 // Scrolls playfield to current gScrollX/Y coords.
-//
-// NOTE: max scroll speed is TILE_SIZE pixels
+// Any number of rows & columns may have scrolled in since last time.
 //
 
 void ScrollPlayfield(void)
@@ -656,24 +853,17 @@ void ScrollPlayfield(void)
 	gScrollRow = gTweenedScrollY / TILE_SIZE;
 
 
-			/* SEE IF SCROLLED A TILE VERTICALLY */
-
-	if (gOldScrollRow != gScrollRow)
-	{
-		if (gScrollRow > gOldScrollRow)							// see which way
-			ScrollPlayfield_Down();
-		else
-			ScrollPlayfield_Up();
-	}
+			/* DRAW THE ROWS & COLUMNS THAT SCROLLED INTO VIEW */
 
-			/* SEE IF SCROLLED A TILE HORIZONTALLY */
+	long dRow = gScrollRow - gOldScrollRow;
+	long dCol = gScrollCol - gOldScrollCol;
 
-	if (gOldScrollCol != gScrollCol)
+	if (dRow || dCol)
 	{
-		if (gScrollCol > gOldScrollCol)							// see which way
-			ScrollPlayfield_Right();
-		else
-			ScrollPlayfield_Left();
+		DrawExposedTiles(dRow < 0 ? -dRow : 0, dRow > 0 ? dRow : 0,
+						dCol < 0 ? -dCol : 0, dCol > 0 ? dCol : 0);
+
+		ScanExposedItems();
 	}
 
 			/* CALC ITEM OUTER BOUNDARY WINDOW */
@@ -706,151 +896,153 @@ void SetItemDeleteWindow(void)
 	gItemDeleteWindow_Right = (gScrollCol+PF_TILE_WIDTH+ITEM_WINDOW_RIGHT+OUTER_SIZE)<<TILE_SIZE_SH;
 }
 
-/****************** SCROLL PLAYFIELD: DOWN **********************/
+/****************** DRAW EXPOSED TILE ROWS **********************/
+//
+// ParallelFor callback: redraws the exposed tiles of view rows [begin, end).
+// Each view row maps to its own row of tiles in the PF buffer, so workers never overlap.
+//
 
-void ScrollPlayfield_Down(void)
+static void DrawExposedTileRows(void* userData, int begin, int end, int workerNum)
 {
-long	row,col,x,mapRow,right;
-
-				/* UPDATE TILES */
-
-	mapRow = gScrollRow+(PF_TILE_HEIGHT-1);						// calc row in map matrix
-
-	row = mapRow % PF_TILE_HEIGHT;								// calc row in buffer
-	col = gScrollCol % PF_TILE_WIDTH;							// calc col in buffer
+	(void) userData;
+	(void) workerNum;
 
-	for (x = 0; x < PF_TILE_WIDTH; x++)
+	for (long y = begin; y < end; y++)
 	{
-		DrawATile(gPlayfield[mapRow][gScrollCol+x],row,col,true);
+		long	mapRow = gScrollRow + y;
+		long	row = mapRow % PF_TILE_HEIGHT;						// calc row in buffer
+		uint16_t* mapPtr = &gPlayfield[mapRow][gScrollCol];
 
-		if (++col >= PF_TILE_WIDTH)
-			col = 0;
-	}
-
-				/* UPDATE ITEMS */
-
-	x = gScrollCol-ITEM_WINDOW_LEFT;							// calc area to check for new items
-	if (x < 0)													// see if out of bounds
-		x = 0;
-	right = gScrollCol+PF_TILE_WIDTH+ITEM_WINDOW_RIGHT;
-	if (right >= gPlayfieldTileWidth)
-		right = gPlayfieldTileWidth-1;
-	mapRow = gScrollRow+PF_TILE_HEIGHT+ITEM_WINDOW_BOTTOM;
-	if (mapRow >= gPlayfieldTileHeight)
-		mapRow = gPlayfieldTileHeight-1;
+		if (y < gExposedRowsAbove || y >= PF_TILE_HEIGHT - gExposedRowsBelow)	// new row: draw all of it
+		{
+			for (long x = 0; x < PF_TILE_WIDTH; x++)
+				DrawATile(mapPtr[x], row, (gScrollCol+x) % PF_TILE_WIDTH, true);
+		}
+		else													// old row: only draw the new columns on either side
+		{
+			for (long x = 0; x < gExposedColsLeft; x++)
+				DrawATile(mapPtr[x], row, (gScrollCol+x) % PF_TILE_WIDTH, true);
 
-	ScanForPlayfieldItems(mapRow,mapRow,x,right);				// scan for any items
+			for (long x = PF_TILE_WIDTH - gExposedColsRight; x < PF_TILE_WIDTH; x++)
+				DrawATile(mapPtr[x], row, (gScrollCol+x) % PF_TILE_WIDTH, true);
+		}
+	}
 }
 
 
-/****************** SCROLL PLAYFIELD: UP **********************/
+/****************** DRAW EXPOSED TILES **********************/
+//
+// Redraws the rows & columns at the edges of the view (at gScrollRow/Col) that
+// aren't in the PF buffer yet.  If the view moved further than the buffer is wide
+// or tall, nothing in the buffer can be reused and the whole view gets redrawn.
+//
 
-void ScrollPlayfield_Up(void)
+static void DrawExposedTiles(long rowsAbove, long rowsBelow, long colsLeft, long colsRight)
 {
-long	row,col,x,right;
-
-				/* UPDATE TILES */
-
-	row = gScrollRow % PF_TILE_HEIGHT;								// calc row in buffer
-	col = gScrollCol % PF_TILE_WIDTH;								// calc col in buffer
-
-	for (x = 0; x < PF_TILE_WIDTH; x++)
+	if (rowsAbove + rowsBelow >= PF_TILE_HEIGHT || colsLeft + colsRight >= PF_TILE_WIDTH)	// jumped past the buffer
 	{
-		DrawATile(gPlayfield[gScrollRow][gScrollCol+x],row,col,true);
-		if (++col >= PF_TILE_WIDTH)
-			col = 0;
+		rowsAbove = PF_TILE_HEIGHT;
+		rowsBelow = colsLeft = colsRight = 0;
 	}
 
+	gExposedRowsAbove = rowsAbove;
+	gExposedRowsBelow = rowsBelow;
+	gExposedColsLeft = colsLeft;
+	gExposedColsRight = colsRight;
 
-				/* UPDATE ITEMS */
-
-	x = gScrollCol-ITEM_WINDOW_LEFT;							// calc area to check for new items
-	if (x < 0)													// see if out of bounds
-		x = 0;
-	right = gScrollCol+PF_TILE_WIDTH+ITEM_WINDOW_RIGHT;
-	if (right >= gPlayfieldTileWidth)
-		right = gPlayfieldTileWidth-1;
-	row = gScrollRow-ITEM_WINDOW_TOP;
-	if (row < 0)
-		row = 0;
-
-	ScanForPlayfieldItems(row,row,x,right);						// scan for any items
+	long numRows = rowsAbove + rowsBelow;
+	long numTiles = numRows * PF_TILE_WIDTH + (PF_TILE_HEIGHT - numRows) * (colsLeft + colsRight);
 
+	if (numTiles < MIN_PARALLEL_TILES)								// not worth waking up the workers
+		DrawExposedTileRows(nil, 0, PF_TILE_HEIGHT, 0);
+	else
+		ParallelFor(PF_TILE_HEIGHT, 1, DrawExposedTileRows, nil);
 }
 
 
-/****************** SCROLL PLAYFIELD: RIGHT **********************/
+/****************** SCAN EXPOSED ITEMS **********************/
 //
-// playfield actually scrolls to the left, but new data added on right side
+// Adds the items in the map rows & columns that entered the item add window
+// since the last scroll (gOldScrollRow/Col -> gScrollRow/Col).
 //
 
-void ScrollPlayfield_Right(void)
+static void ScanExposedItems(void)
 {
-long	row,col,y,mapCol,mapRowTop,mapRowBot;
+long	top,bottom,left,right;
 
-				/* UPDATE TILES */
+				/* NEW ROWS */
 
-	mapCol = gScrollCol+(PF_TILE_WIDTH-1);						// calc col in map matrix
-	row = gScrollRow % PF_TILE_HEIGHT;							// calc row in buffer
-	col = mapCol  % PF_TILE_WIDTH;								// calc col in buffer
-
-	for (y = 0; y < PF_TILE_HEIGHT; y++)
+	if (gScrollRow != gOldScrollRow)
 	{
-		DrawATile(gPlayfield[gScrollRow+y][mapCol],row,col,true);
-		if (++row >= PF_TILE_HEIGHT)
-			row = 0;
-	}
-
-				/* UPDATE ITEMS */
-
-	mapCol = gScrollCol+PF_TILE_WIDTH+ITEM_WINDOW_RIGHT;		// calc column to check for new objects
-	if (mapCol >= gPlayfieldTileWidth)								// see if out of bounds
-		return;
-
-	mapRowTop = gScrollRow-ITEM_WINDOW_TOP;						// calc top/bottom bounds
-	if (mapRowTop < 0)
-		mapRowTop = 0;
-	mapRowBot = gScrollRow+PF_TILE_HEIGHT+ITEM_WINDOW_BOTTOM;
-	if (mapRowBot >= gPlayfieldTileHeight)
-		mapRowBot = gPlayfieldTileHeight-1;
-
-	ScanForPlayfieldItems(mapRowTop,mapRowBot,mapCol,mapCol);	// scan for any items
-
-}
-
-/****************** SCROLL PLAYFIELD: LEFT **********************/
-
-void ScrollPlayfield_Left(void)
-{
-long	row,col,y,mapRowTop,mapRowBot,mapCol;
-
-				/* UPDATE TILES */
-
-	row = gScrollRow % PF_TILE_HEIGHT;							// calc row in buffer
-	col = gScrollCol  % PF_TILE_WIDTH;								// calc col in buffer
+		if (gScrollRow > gOldScrollRow)								// scrolled down: rows below old add window
+		{
+			top = gOldScrollRow+PF_TILE_HEIGHT+ITEM_WINDOW_BOTTOM+1;
+			bottom = gScrollRow+PF_TILE_HEIGHT+ITEM_WINDOW_BOTTOM;
+			if (top < gScrollRow-ITEM_WINDOW_TOP)					// jumped past old window
+				top = gScrollRow-ITEM_WINDOW_TOP;
+		}
+		else														// scrolled up: rows above old add window
+		{
+			top = gScrollRow-ITEM_WINDOW_TOP;
+			bottom = gOldScrollRow-ITEM_WINDOW_TOP-1;
+			if (bottom > gScrollRow+PF_TILE_HEIGHT+ITEM_WINDOW_BOTTOM)
+				bottom = gScrollRow+PF_TILE_HEIGHT+ITEM_WINDOW_BOTTOM;
+		}
 
-	for (y = 0; y < PF_TILE_HEIGHT; y++)
-	{
-		DrawATile(gPlayfield[gScrollRow+y][gScrollCol],row,col,true);
-		if (++row >= PF_TILE_HEIGHT)
-			row = 0;
+		if (top < 0)												// keep within map
+			top = 0;
+		if (top >= gPlayfieldTileHeight)
+			top = gPlayfieldTileHeight-1;
+		if (bottom < 0)
+			bottom = 0;
+		if (bottom >= gPlayfieldTileHeight)
+			bottom = gPlayfieldTileHeight-1;
+
+		left = gScrollCol-ITEM_WINDOW_LEFT;							// across the whole add window
+		if (left < 0)
+			left = 0;
+		right = gScrollCol+PF_TILE_WIDTH+ITEM_WINDOW_RIGHT;
+		if (right >= gPlayfieldTileWidth)
+			right = gPlayfieldTileWidth-1;
+
+		ScanForPlayfieldItems(top,bottom,left,right);				// scan for any items
 	}
 
-				/* UPDATE ITEMS */
-
-	mapCol = gScrollCol-ITEM_WINDOW_RIGHT;						// calc column to check for new objects
-	if (mapCol < 0)												// see if out of bounds
-		return;
-
-	mapRowTop = gScrollRow-ITEM_WINDOW_TOP;						// calc top/bottom bounds
-	if (mapRowTop < 0)
-		mapRowTop = 0;
-	mapRowBot = gScrollRow+PF_TILE_HEIGHT+ITEM_WINDOW_BOTTOM;
-	if (mapRowBot >= gPlayfieldTileHeight)
-		mapRowBot = gPlayfieldTileHeight-1;
+				/* NEW COLUMNS */
 
+	if (gScrollCol != gOldScrollCol)
+	{
+		if (gScrollCol > gOldScrollCol)								// scrolled right: cols right of old add window
+		{
+			left = gOldScrollCol+PF_TILE_WIDTH+ITEM_WINDOW_RIGHT+1;
+			right = gScrollCol+PF_TILE_WIDTH+ITEM_WINDOW_RIGHT;
+			if (left < gScrollCol-ITEM_WINDOW_LEFT)					// jumped past old window
+				left = gScrollCol-ITEM_WINDOW_LEFT;
+		}
+		else														// scrolled left: cols left of old add window
+		{
+			left = gScrollCol-ITEM_WINDOW_LEFT;
+			right = gOldScrollCol-ITEM_WINDOW_LEFT-1;
+			if (right > gScrollCol+PF_TILE_WIDTH+ITEM_WINDOW_RIGHT)
+				right = gScrollCol+PF_TILE_WIDTH+ITEM_WINDOW_RIGHT;
+		}
 
-	ScanForPlayfieldItems(mapRowTop,mapRowBot,mapCol,mapCol);	// scan for any items
+		if (left < 0)												// see if out of bounds
+			left = 0;
+		if (right >= gPlayfieldTileWidth)
+			right = gPlayfieldTileWidth-1;
+		if (left > right)
+			return;
+
+		top = gScrollRow-ITEM_WINDOW_TOP;							// calc top/bottom bounds
+		if (top < 0)
+			top = 0;
+		bottom = gScrollRow+PF_TILE_HEIGHT+ITEM_WINDOW_BOTTOM;
+		if (bottom >= gPlayfieldTileHeight)
+			bottom = gPlayfieldTileHeight-1;
+
+		ScanForPlayfieldItems(top,bottom,left,right);				// scan for any items
+	}
 }
 
 
@@ -941,17 +1133,20 @@ long	scrollDX, scrollDY;
 	}
 
 
-	if (scrollDX > (TILE_SIZE-1))								// limit scroll speed
-		scrollDX = (TILE_SIZE-1);
-	else
-	if (scrollDX < -(TILE_SIZE-1))
-		scrollDX = -(TILE_SIZE-1);
+	if (!gTeleportingFlag)									// limit scroll speed, unless teleporting: then cut straight there
+	{
+		if (scrollDX > (TILE_SIZE-1))
+			scrollDX = (TILE_SIZE-1);
+		else
+		if (scrollDX < -(TILE_SIZE-1))
+			scrollDX = -(TILE_SIZE-1);
 
-	if (scrollDY > (TILE_SIZE-1))
-		scrollDY = (TILE_SIZE-1);
-	else
-	if (scrollDY < -(TILE_SIZE-1))
-		scrollDY = -(TILE_SIZE-1);
+		if (scrollDY > (TILE_SIZE-1))
+			scrollDY = (TILE_SIZE-1);
+		else
+		if (scrollDY < -(TILE_SIZE-1))
+			scrollDY = -(TILE_SIZE-1);
+	}
 
 
 	gScrollX += scrollDX;									// move it
@@ -981,6 +1176,12 @@ long	scrollDX, scrollDY;
 		scrollDY = 0;
 	}
 
+	if (gTeleportingFlag)									// don't tween the camera across the map on a cut
+	{
+		gOldScrollX = gScrollX;
+		gOldScrollY = gScrollY;
+	}
+
 	if (!(scrollDX || scrollDY))							// stop teleporting when screen stops
 		gTeleportingFlag = false;
 }
@@ -1277,40 +1478,32 @@ Handle		tempHand;
 
 void DrawATile(unsigned short tileNum, short row, short col, Boolean maskFlag)
 {
-unsigned char *destPtr,*srcPtr,*destCopyPtr;
-long		height,i;
-Ptr			destStartPtr,destCopyStartPtr;
-unsigned char	*copyOfSrc;
 unsigned long	rowS,colS;								// shifted version of row & col
-Byte		pixel;
-Ptr			destPtrB,srcPtrB;
 
 					/* CALC DEST POINTERS */
 
-	destStartPtr = (Ptr)(gPFLookUpTable[rowS = row<<TILE_SIZE_SH]+(colS = col<<TILE_SIZE_SH));
-	destCopyStartPtr = (Ptr)(gPFCopyLookUpTable[rowS]+colS);
+	uint8_t* destPtr = (uint8_t*) (gPFLookUpTable[rowS = row<<TILE_SIZE_SH]+(colS = col<<TILE_SIZE_SH));
+	uint8_t* destCopyPtr = (uint8_t*) (gPFCopyLookUpTable[rowS]+colS);
 
 					/* CALC TILE DEFINITION ADDR */
 
 	GAME_ASSERT(HandleBoundsCheck(gTileSetHandle, (Ptr) &gTileXlatePtr[tileNum & TILENUM_MASK]));
 
 	int xlate = gTileXlatePtr[tileNum&TILENUM_MASK];
+	GAME_ASSERT(xlate >= 0 && xlate < gNumTileDefinitions);
 
-	copyOfSrc = srcPtr = (unsigned char *)(gTilesPtr + (xlate<<(TILE_SIZE_SH*2)));
-	destPtr = (unsigned char *)destStartPtr;
-	destCopyPtr = (unsigned char *)destCopyStartPtr;
+	const uint8_t* srcPtr = (const uint8_t*) gTilesPtr + (xlate<<(TILE_SIZE_SH*2));
 
 						/* DRAW THE TILE */
 
-	height = TILE_SIZE;
-	do
+	for (int y = 0; y < TILE_SIZE; y++)
 	{
-		for (i = 0; i < TILE_SIZE; i++)
-			destPtr[i] = destCopyPtr[i] = *srcPtr++;
-
-		destPtr += PF_BUFFER_WIDTH;							// next line
-		destCopyPtr += PF_BUFFER_WIDTH;
-	}while(--height);
+		memcpy(destPtr,		srcPtr,	TILE_SIZE);
+		memcpy(destCopyPtr,	srcPtr,	TILE_SIZE);
+		destPtr		+= PF_BUFFER_WIDTH;					// next line
+		destCopyPtr	+= PF_BUFFER_WIDTH;
+		srcPtr		+= TILE_SIZE;
+	}
 
 
 					/************************/
@@ -1319,55 +1512,36 @@ Ptr			destPtrB,srcPtrB;
 
 	if (maskFlag)
 	{
-		destPtr = (unsigned char *)(gPFMaskLookUpTable[rowS]+colS);
+		uint8_t* maskPtr = (uint8_t*) (gPFMaskLookUpTable[rowS]+colS);
+		const uint8_t* maskSrcPtr = nil;
+		int fill = 0x00;									// clear mask here
+
 		if (tileNum&TILE_PRIORITY_MASK)
 		{
-			if (tileNum&TILE_PRIORITY_MASK2)						// see if do pixel accurate mask or just tile mask
+			if (tileNum&TILE_PRIORITY_MASK2)				// see if do pixel accurate mask or just tile mask
 			{
+				int32_t info = gTileMaskInfo[xlate];		// pixel mask was classified & built by LoadTileSet
 
-						/* DRAW PIXEL TILE MASK */
-
-				destPtrB = (Ptr)destPtr;
-				srcPtrB = (Ptr)copyOfSrc;
-				height = TILE_SIZE;
-				do
-				{
-					for (i=0; i < TILE_SIZE; i++)
-					{
-						pixel = *srcPtrB++;							// get pixel value
-
-						if (gColorMaskArray[pixel])
-							*destPtrB++ = 0xff;						// make xparent
-						else
-							*destPtrB++ = 0x00;						// make solid
-					}
-					destPtrB += PF_BUFFER_WIDTH-TILE_SIZE;			// next line
-				} while(--height);
-
+				if (info >= 0)
+					maskSrcPtr = (const uint8_t*) gTileMasks + info;
+				else
+					fill = (info == kTileMask_Solid)? 0xff: 0x00;
 			}
-							/* DRAW WHOLE TILE MASK */
 			else
-			{
-				height = TILE_SIZE;
-				do
-				{
-					for (i = 0; i < TILE_SIZE; i++)
-						destPtr[i] = 0xff;
-					destPtr += PF_BUFFER_WIDTH;			// next line
-				} while (--height);
-			}
+				fill = 0xff;								// whole tile mask
 		}
-		else
-		{
-						/* CLEAR MASK HERE */
 
-			height = TILE_SIZE;
-			do
+		for (int y = 0; y < TILE_SIZE; y++)
+		{
+			if (maskSrcPtr)
 			{
-				for (i = 0; i < TILE_SIZE; i++)
-					destPtr[i] = 0;
-				destPtr += PF_BUFFER_WIDTH;			// next line
-			} while (--height);
+				memcpy(maskPtr, maskSrcPtr, TILE_SIZE);
+				maskSrcPtr += TILE_SIZE;
+			}
+			else
+				memset(maskPtr, fill, TILE_SIZE);
+
+			maskPtr += PF_BUFFER_WIDTH;						// next line
 		}
 	}
 }
@@ -1416,15 +1590,123 @@ unsigned long	rowS,colS;								// shifted version of row & col
 
 
 
+/********************* DISPLAY PLAYFIELD (INTERLACED) ***************/
+//
+// Copies every other line of the playfield to the screen, leaving the blank lines set up by EraseStore alone.
+// The source may wrap around both edges of the PF buffer.
+//
+
+static void DisplayPlayfield_Interlaced(long left, long top)
+{
+	for (long y = 0; y < PF_WINDOW_HEIGHT; y += 2)
+	{
+		CopyPlayfieldRow(left, top, y);
+		MarkFramebufferRowsDirty(PF_WINDOW_TOP + y, 1);
+	}
+}
+
+
+/********************* COPY PLAYFIELD ROW ***************/
+//
+// Copies line y of the playfield window to the screen.
+// left/top are the PF buffer pixel coords of the window; the source may wrap around both edges.
+// The present's converters call this from worker threads, one row each.
+//
+
+void CopyPlayfieldRow(long left, long top, long y)
+{
+	long width0 = PF_BUFFER_WIDTH - left;					// columns before the PF buffer wraps around
+	if (width0 > PF_WINDOW_WIDTH)
+		width0 = PF_WINDOW_WIDTH;
+
+	Ptr srcPtr = gPFLookUpTable[(top + y) % PF_BUFFER_HEIGHT];
+	uint8_t* destPtr = gScreenLookUpTable[PF_WINDOW_TOP + y] + PF_WINDOW_LEFT;
+
+	memcpy(destPtr, srcPtr + left, width0);
+	memcpy(destPtr + width0, srcPtr, PF_WINDOW_WIDTH - width0);
+}
+
+
 /********************* DISPLAY PLAYFIELD ***************/
 //
 // Dump Current playfield area to the screen
 //
+// With gFusedPlayfield, the copy is left to the next (synchronous) present instead:
+// its worker threads copy each row right before converting it to RGBA.
+// Anything that changes the PF buffer or reads the screen before then must call
+// FlushPendingPlayfieldCopy first.
+//
 
 void DisplayPlayfield(void)
 {
+long		top,left;
+
+	left	= PositiveModulo(gTweenedScrollX + gShakeyScreenOffsetX, PF_BUFFER_WIDTH);		// get PF buffer pixel coords to start @
+	top		= PositiveModulo(gTweenedScrollY + gShakeyScreenOffsetY, PF_BUFFER_HEIGHT);
+
+	gPlayfieldCopyPending = false;							// whatever was pending is superseded
+
+	if (IsInterlacedRow(PF_WINDOW_TOP + 1))				// EraseStore has set up the blank lines
+	{
+		DisplayPlayfield_Interlaced(left, top);
+		return;
+	}
+
+	if (gFusedPlayfield && !gGamePrefs.pipelinedPresent)	// let the present copy it
+	{
+		gPlayfieldCopyPending = true;
+		gPendingPlayfieldLeft = left;
+		gPendingPlayfieldTop = top;
+	}
+	else
+		CopyPlayfieldToFramebuffer(left, top);
+
+	MarkFramebufferRowsDirty(PF_WINDOW_TOP, PF_WINDOW_HEIGHT);
+}
+
+
+/********************* TAKE PENDING PLAYFIELD COPY ***************/
+//
+// Called by the present code when its converters will copy the playfield themselves.
+// Returns false if DisplayPlayfield has already done the copy.
+//
+
+Boolean TakePendingPlayfieldCopy(long* left, long* top)
+{
+	if (!gPlayfieldCopyPending)
+		return false;
+
+	*left = gPendingPlayfieldLeft;
+	*top = gPendingPlayfieldTop;
+	gPlayfieldCopyPending = false;
+	return true;
+}
+
+
+/********************* FLUSH PENDING PLAYFIELD COPY ***************/
+//
+// Does the copy that DisplayPlayfield deferred, if nobody has taken it yet.
+//
+
+void FlushPendingPlayfieldCopy(void)
+{
+	if (gPlayfieldCopyPending)
+	{
+		gPlayfieldCopyPending = false;
+		CopyPlayfieldToFramebuffer(gPendingPlayfieldLeft, gPendingPlayfieldTop);
+	}
+}
+
+
+/********************* COPY PLAYFIELD TO FRAMEBUFFER ***************/
+//
+// Copies the whole playfield window to the screen in up to 4 segments.
+//
+
+static void CopyPlayfieldToFramebuffer(long left, long top)
+{
 Ptr			destPtr,srcPtr;
-long		top,left,width;
+long		width;
 unsigned long	height;
 long		numSegments,seg;
 Ptr			destPtrs[4];
@@ -1434,15 +1716,12 @@ long		widths[4];
 long		srcAdd,destAdd;
 long		method;
 
-	left	= PositiveModulo(gTweenedScrollX + gShakeyScreenOffsetX, PF_BUFFER_WIDTH);		// get PF buffer pixel coords to start @
-	top		= PositiveModulo(gTweenedScrollY + gShakeyScreenOffsetY, PF_BUFFER_HEIGHT);
-
-	if ((left+(PF_WINDOW_WIDTH-1)) > PF_BUFFER_WIDTH)		// see if 2 horiz segments
+	if ((left+PF_WINDOW_WIDTH) > PF_BUFFER_WIDTH)		// see if 2 horiz segments
 	{
 
 						/* 2 HORIZ SEGMENTS */
 
-		if ((top+(PF_WINDOW_HEIGHT-1)) > PF_BUFFER_HEIGHT)	// see if 2 vertical segments
+		if ((top+PF_WINDOW_HEIGHT) > PF_BUFFER_HEIGHT)	// see if 2 vertical segments
 		{
 			method = 0;
 			numSegments = 4;
@@ -1476,7 +1755,7 @@ long		method;
 					/* ONLY 1 HORIZ SEGMENT */
 	else
 	{
-		if ((top+(PF_WINDOW_HEIGHT-1)) > PF_BUFFER_HEIGHT)			// see if 2 vertical segments
+		if ((top+PF_WINDOW_HEIGHT) > PF_BUFFER_HEIGHT)			// see if 2 vertical segments
 		{
 			method = 2;
 			numSegments = 2;
@@ -1592,59 +1871,66 @@ long		method;
 
 void UpdateTileAnimation(void)
 {
-unsigned long	row;
 unsigned short	newTile;
-uint16_t	targetTile,*intPtr,*basePtr;
-register long	col;
-register long	x,y,animNum;
 unsigned long 	origRow,origCol;
 
 	origRow = gScrollRow % PF_TILE_HEIGHT;									// calc row in buffer
 	origCol = gScrollCol % PF_TILE_WIDTH;									// calc col in buffer
 
-	for (animNum = 0; animNum < gNumTileAnims; animNum++)
+	for (int animNum = 0; animNum < gNumTileAnims; animNum++)
 	{
+		TileAnimEntryType* anim = &gTileAnims[animNum];
+
 						/* CHECK COUNTER */
 
-		if ((gTileAnims[animNum].count -= gTileAnims[animNum].defPtr->speed) < 0)
+		if ((anim->count -= anim->defPtr->speed) < 0)
 		{
-			gTileAnims[animNum].count = 0x100;								// reset counter
+			anim->count = 0x100;											// reset counter
 
-						/* SCAN VISIBLE AREA FOR TARGET TILE */
+			newTile = anim->defPtr->tileNums[anim->index];					// get tile to draw
 
-			targetTile = gTileAnims[animNum].defPtr->baseTile;				// get target basetile
-			newTile = gTileAnims[animNum].defPtr->tileNums[gTileAnims[animNum].index];	// get tile to draw
+						/* DRAW AT EVERY INDEXED POSITION IN VISIBLE AREA */
 
-			basePtr = (unsigned short *)&gPlayfield[gScrollRow][gScrollCol]; // get ptr to start of scan
+			GAME_ASSERT(anim->rowStart);
 
-			row = origRow;													// get modable row
+			unsigned long row = origRow;									// get modable row
 
-			y = 0;
-			do
+			for (long y = 0; y < PF_TILE_HEIGHT && gScrollRow + y < gPlayfieldTileHeight; y++)
 			{
-				intPtr = basePtr;											// get ptr to start of horiz scan
-				col = origCol;
-				x = PF_TILE_WIDTH;
+				long mapRow = gScrollRow + y;
+
+				const uint16_t* cols = anim->mapCols;
+				int32_t i = anim->rowStart[mapRow];
+				int32_t end = anim->rowStart[mapRow+1];
+
+				for (int32_t n = end - i; n > 0; )							// columns are sorted: binary search for left edge of view
+				{
+					int32_t half = n / 2;
+					if (cols[i + half] < gScrollCol)
+					{
+						i += half + 1;
+						n -= half + 1;
+					}
+					else
+						n = half;
+				}
 
-				do
+				for (; i < end; i++)
 				{
-					if ((*intPtr++ & TILENUM_MASK) == targetTile)
-						DrawATile_Simple(newTile,row,col);
+					long x = cols[i] - gScrollCol;
+
+					if (x >= PF_TILE_WIDTH)									// stop at right edge of view
+						break;
 
-					if (++col >= PF_TILE_WIDTH)								// see if column wrap
-						col = 0;
-				} while (--x);
+					DrawATile_Simple(newTile, row, (origCol + x) % PF_TILE_WIDTH);
+				}
 
 				if (++row >= (unsigned long) PF_TILE_HEIGHT)				// see if row wrap
 					row = 0;
+			}
 
-				basePtr += gPlayfieldTileWidth;								// next row in map
-			} while (++y < PF_TILE_HEIGHT);
-
-
-			y = ++gTileAnims[animNum].index;								// increment index
-			if (y  >= gTileAnims[animNum].defPtr->numFrames)				// see if at end of sequence
-				gTileAnims[animNum].index = 0;
+			if (++anim->index >= anim->defPtr->numFrames)					// see if at end of sequence
+				anim->index = 0;
 		}
 	}
 }